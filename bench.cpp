@@ -0,0 +1,530 @@
+// micro-benchmarks for the engine's hot paths. The CPU-side ones need no GL; the rest run against a headless EGL
+// context (Mesa's llvmpipe is fine) when the build has one. --json prints a JSON object per line instead of text,
+// for comparing runs commit to commit, and --filter runs only the benchmarks whose name contains the given text.
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "bounds.h"
+#include "bvh.h"
+#include "camera.h"
+#include "entity_store.h"
+#include "frustum.h"
+#include "gl_interceptor.h"
+#include "job_system.h"
+#include "material.h"
+#include "model.h"
+#include "occlusion.h"
+#include "profiler.h"
+#include "shader.h"
+#ifdef LEARNOPENGL_HEADLESS
+#include "headless.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static bool jsonOutput = false;
+static string filter;
+
+static double elapsedMilliseconds(chrono::high_resolution_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// keeps the optimizer from dropping work whose result isn't otherwise used
+static volatile float sink;
+
+static bool selected(const string &name)
+{
+    return filter.empty() || name.find(filter) != string::npos;
+}
+
+// one line per benchmark: items processed, the time they took and whatever else the benchmark counts
+static void report(const string &name, size_t items, double ms, const vector<pair<string, double>> &extra = {})
+{
+    double nanoseconds = ms * 1.0e6 / max<size_t>(items, 1);
+    if (jsonOutput)
+    {
+        cout << "{\"name\": \"" << name << "\", \"items\": " << items << ", \"ms\": " << ms
+             << ", \"ns_per_item\": " << nanoseconds;
+        for (const auto &value : extra)
+            cout << ", \"" << value.first << "\": " << value.second;
+        cout << "}" << endl;
+        return;
+    }
+    cout << name << ": " << items << " in " << ms << "ms, " << nanoseconds << "ns each";
+    for (const auto &value : extra)
+        cout << ", " << value.first << " " << value.second;
+    cout << endl;
+}
+
+// Runs body(), which processes itemsPerCall items, enough times to take MIN_MILLISECONDS, REPETITIONS times over,
+// and reports the median repetition with the fastest as an extra. The median is what regressions should be
+// judged on, the fastest shows how much of it was noise.
+template <typename Body>
+static void measure(const string &name, size_t itemsPerCall, Body body)
+{
+    const double MIN_MILLISECONDS = 50.0;
+    const int REPETITIONS = 7;
+    if (!selected(name))
+        return;
+
+    // calibrate: double the calls per repetition until one takes long enough
+    size_t calls = 1;
+    for (;;)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < calls; i++)
+            body();
+        if (elapsedMilliseconds(start) >= MIN_MILLISECONDS || calls >= (1u << 30))
+            break;
+        calls *= 2;
+    }
+
+    vector<double> times;
+    for (int r = 0; r < REPETITIONS; r++)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < calls; i++)
+            body();
+        times.push_back(elapsedMilliseconds(start));
+    }
+    sort(times.begin(), times.end());
+    size_t items = calls * itemsPerCall;
+    report(name, items, times[times.size() / 2], {{"min_ns_per_item", times.front() * 1.0e6 / items}});
+}
+
+// some arithmetic that takes roughly a microsecond, standing in for a small job's payload
+static float busyWork(unsigned int seed)
+{
+    float value = static_cast<float>(seed);
+    for (int i = 0; i < 200; i++)
+        value = sqrtf(value * 1.0001f + 1.0f);
+    return value;
+}
+
+// boxes scattered through a cube, sized like the meshes of a typical scene
+static vector<AABB> randomBoxes(size_t count, float extent, unsigned int seed)
+{
+    mt19937 random(seed);
+    uniform_real_distribution<float> position(-extent, extent), size(0.1f, 2.0f);
+    vector<AABB> boxes(count);
+    for (AABB &box : boxes)
+    {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 half(size(random), size(random), size(random));
+        box.min = center - half;
+        box.max = center + half;
+    }
+    return boxes;
+}
+
+// a camera at the origin looking down -z, as the culling benchmarks see the boxes
+static Frustum benchmarkFrustum()
+{
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return Frustum::FromMatrix(projection * view);
+}
+
+// job system
+// ----------
+
+// empty jobs submitted one by one from the main thread, then waited on as a group: the cost of a job itself
+static void benchmarkSpawn(JobSystem &jobs, unsigned int jobCount)
+{
+    if (!selected("job_spawn"))
+        return;
+    jobs.ResetStats();
+    vector<JobHandle> handles;
+    handles.reserve(jobCount);
+    auto start = chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < jobCount; i++)
+        handles.push_back(jobs.Run([]() {}));
+    for (const JobHandle &handle : handles)
+        jobs.Wait(handle);
+    double ms = elapsedMilliseconds(start);
+    JobStats stats = jobs.Stats();
+    report("job_spawn", jobCount, ms, {{"threads", jobs.ThreadCount()}, {"stolen", stats.stolen}, {"overflowed", stats.overflowed}});
+}
+
+// one job fans out into many children from a worker's deque, so everything the others run is stolen
+static void benchmarkSteal(JobSystem &jobs, unsigned int jobCount)
+{
+    if (!selected("job_steal"))
+        return;
+    jobs.ResetStats();
+    auto start = chrono::high_resolution_clock::now();
+    JobHandle root = jobs.Run([&jobs, jobCount]() {
+        vector<JobHandle> children;
+        children.reserve(jobCount);
+        for (unsigned int i = 0; i < jobCount; i++)
+            children.push_back(jobs.Run([i]() { sink = busyWork(i); }));
+        for (const JobHandle &child : children)
+            jobs.Wait(child);
+    });
+    jobs.Wait(root);
+    double ms = elapsedMilliseconds(start);
+    JobStats stats = jobs.Stats();
+    report("job_steal", jobCount, ms, {{"threads", jobs.ThreadCount()}, {"stolen_percent", 100.0 * stats.stolen / jobCount}});
+}
+
+// a chain where each job depends on the one before, measures dependency release latency
+static void benchmarkDependencies(JobSystem &jobs, unsigned int chainLength)
+{
+    if (!selected("job_chain"))
+        return;
+    auto start = chrono::high_resolution_clock::now();
+    JobHandle previous = jobs.Create([]() {});
+    JobHandle first = previous;
+    vector<JobHandle> chain;
+    for (unsigned int i = 1; i < chainLength; i++)
+    {
+        JobHandle next = jobs.Create([]() {});
+        jobs.AddDependency(next, previous);
+        chain.push_back(next);
+        previous = next;
+    }
+    for (const JobHandle &job : chain)
+        jobs.Submit(job);
+    jobs.Submit(first);
+    jobs.Wait(previous);
+    report("job_chain", chainLength, elapsedMilliseconds(start), {{"threads", jobs.ThreadCount()}});
+}
+
+// the same parallel-for at every thread count, speedup is relative to one thread
+static void benchmarkScaling(unsigned int maxThreads, size_t itemCount, size_t grain)
+{
+    if (!selected("parallel_for"))
+        return;
+    vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    vector<float> values(itemCount);
+    double baseline = 0.0;
+    for (unsigned int threads : threadCounts)
+    {
+        JobSystem jobs(threads);
+        auto start = chrono::high_resolution_clock::now();
+        jobs.ParallelFor(itemCount, grain, [&values](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                values[i] = busyWork(static_cast<unsigned int>(i));
+        });
+        double ms = elapsedMilliseconds(start);
+        if (threads == 1)
+            baseline = ms;
+        report("parallel_for/" + to_string(threads), itemCount, ms, {{"speedup", baseline / ms}});
+    }
+}
+
+// loader
+// ------
+
+// Model::ImportGeometry on a generated mesh with every attribute present, per vertex
+static void benchmarkImportGeometry(unsigned int gridSize)
+{
+    aiMesh mesh;
+    unsigned int vertexCount = gridSize * gridSize;
+    mesh.mNumVertices = vertexCount;
+    mesh.mVertices = new aiVector3D[vertexCount];
+    mesh.mNormals = new aiVector3D[vertexCount];
+    mesh.mTangents = new aiVector3D[vertexCount];
+    mesh.mBitangents = new aiVector3D[vertexCount];
+    mesh.mTextureCoords[0] = new aiVector3D[vertexCount];
+    for (unsigned int i = 0; i < vertexCount; i++)
+    {
+        float u = static_cast<float>(i % gridSize) / gridSize, v = static_cast<float>(i / gridSize) / gridSize;
+        mesh.mVertices[i] = aiVector3D(u, 0.0f, v);
+        mesh.mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+        mesh.mTangents[i] = aiVector3D(1.0f, 0.0f, 0.0f);
+        mesh.mBitangents[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+        mesh.mTextureCoords[0][i] = aiVector3D(u, v, 0.0f);
+    }
+    unsigned int quads = (gridSize - 1) * (gridSize - 1);
+    mesh.mNumFaces = quads * 2;
+    mesh.mFaces = new aiFace[mesh.mNumFaces];
+    for (unsigned int q = 0; q < quads; q++)
+    {
+        unsigned int corner = q / (gridSize - 1) * gridSize + q % (gridSize - 1);
+        unsigned int triangles[2][3] = {{corner, corner + gridSize, corner + 1}, {corner + 1, corner + gridSize, corner + gridSize + 1}};
+        for (int t = 0; t < 2; t++)
+        {
+            aiFace &face = mesh.mFaces[2 * q + t];
+            face.mNumIndices = 3;
+            face.mIndices = new unsigned int[3];
+            copy(triangles[t], triangles[t] + 3, face.mIndices);
+        }
+    }
+
+    measure("import_geometry", vertexCount, [&mesh]() {
+        MeshData data;
+        Model::ImportGeometry(&mesh, data);
+        sink = data.vertices.back().Position.x;
+    });
+}
+
+// camera
+// ------
+
+static void benchmarkCamera()
+{
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    float offset = 1.0f;
+    measure("camera_mouse_movement", 1, [&camera, &offset]() {
+        offset = -offset;
+        camera.ProcessMouseMovement(offset, offset * 0.5f);
+    });
+    measure("camera_view_matrix", 1, [&camera]() {
+        sink = camera.GetViewMatrix()[3][2];
+    });
+}
+
+// culling
+// -------
+
+// the frustum culler as Model::Draw uses it: every box added, then culled, each frame
+static void benchmarkFrustumCull(size_t boxCount)
+{
+    vector<AABB> boxes = randomBoxes(boxCount, 100.0f, 1);
+    Frustum frustum = benchmarkFrustum();
+    FrustumCuller culler;
+    vector<unsigned int> visible;
+    measure("frustum_cull", boxCount, [&]() {
+        for (const AABB &box : boxes)
+            culler.Add(box);
+        culler.Cull(frustum, visible);
+        culler.EndFrame();
+    });
+}
+
+static void benchmarkBvh(size_t boxCount)
+{
+    vector<AABB> boxes = randomBoxes(boxCount, 100.0f, 2);
+    SceneBVH bvh;
+    measure("bvh_build", boxCount, [&]() { bvh.Build(boxes); });
+
+    Frustum frustum = benchmarkFrustum();
+    vector<unsigned int> visible;
+    bvh.Build(boxes);
+    measure("bvh_cull", boxCount, [&]() {
+        visible.clear();
+        bvh.Cull(frustum, visible);
+    });
+    measure("bvh_refit", boxCount, [&]() { bvh.Refit(boxes); });
+}
+
+static void benchmarkEntityUpdate(size_t entityCount)
+{
+    EntityStore entities;
+    mt19937 random(3);
+    uniform_real_distribution<float> position(-100.0f, 100.0f);
+    AABB unitBox;
+    unitBox.min = glm::vec3(-0.5f);
+    unitBox.max = glm::vec3(0.5f);
+    for (size_t i = 0; i < entityCount; i++)
+        entities.Create(glm::vec3(position(random), position(random), position(random)),
+                        glm::angleAxis(position(random), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(1.0f), unitBox,
+                        static_cast<unsigned int>(i));
+    measure("entity_update", entityCount, [&entities]() { entities.Update(); });
+}
+
+// a wall of triangles rasterized into the software depth buffer, then boxes behind and beside it tested
+static void benchmarkOcclusion(unsigned int wallSize, size_t boxCount)
+{
+    OccluderMesh wall;
+    for (unsigned int y = 0; y < wallSize; y++)
+        for (unsigned int x = 0; x < wallSize; x++)
+        {
+            float x0 = -5.0f + 10.0f * x / wallSize, x1 = -5.0f + 10.0f * (x + 1) / wallSize;
+            float y0 = -5.0f + 10.0f * y / wallSize, y1 = -5.0f + 10.0f * (y + 1) / wallSize;
+            for (glm::vec3 corner : {glm::vec3(x0, y0, 0.0f), glm::vec3(x1, y0, 0.0f), glm::vec3(x0, y1, 0.0f),
+                                     glm::vec3(x1, y0, 0.0f), glm::vec3(x1, y1, 0.0f), glm::vec3(x0, y1, 0.0f)})
+            {
+                wall.positions.push_back(corner);
+                wall.bounds.Expand(corner);
+            }
+        }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 8.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 wallTransform(1.0f);
+
+    OcclusionCuller occlusion(256, 128);
+    measure("occlusion_rasterize", wall.positions.size() / 3, [&]() {
+        occlusion.BeginFrame(projection * view);
+        occlusion.AddOccluder(wall, wallTransform);
+        occlusion.Rasterize();
+        occlusion.EndFrame();
+    });
+
+    vector<AABB> boxes = randomBoxes(boxCount, 8.0f, 4);
+    for (AABB &box : boxes)
+    {
+        // everything behind the wall, some of it peeking out past its edges
+        box.min.z -= 10.0f;
+        box.max.z -= 10.0f;
+    }
+    occlusion.BeginFrame(projection * view);
+    occlusion.AddOccluder(wall, wallTransform);
+    occlusion.Rasterize();
+    measure("occlusion_test", boxCount, [&]() {
+        unsigned int visible = 0;
+        for (const AABB &box : boxes)
+            visible += occlusion.Test(box);
+        sink = static_cast<float>(visible);
+    });
+}
+
+// profiler
+// --------
+
+// what a zone costs while the profiler is off, which is all the time zones spend in the code, and while recording
+static void benchmarkProfileZone()
+{
+    Profiler::SetEnabled(false);
+    measure("profile_zone_disabled", 1, []() { PROFILE_ZONE("benchmark"); });
+    Profiler::SetEnabled(true);
+    measure("profile_zone_enabled", 1, []() { PROFILE_ZONE("benchmark"); });
+    Profiler::SetEnabled(false);
+}
+
+// GL
+// --
+
+// texture paths looked up in the material library once they're known, as every mesh sharing a texture does
+static void benchmarkTextureLookup(unsigned int textureCount)
+{
+    MaterialLibrary library;
+    vector<string> paths;
+    for (unsigned int i = 0; i < textureCount; i++)
+        paths.push_back("/nonexistent/benchmark/textures/texture_" + to_string(i) + ".png");
+    // the files don't exist, but failed loads are remembered like successful ones
+    streambuf *output = cout.rdbuf(nullptr);
+    for (const string &path : paths)
+        library.AddTexture(path);
+    cout.rdbuf(output);
+
+    measure("texture_lookup", paths.size(), [&]() {
+        int layers = 0;
+        for (const string &path : paths)
+            layers += library.AddTexture(path).layer;
+        sink = static_cast<float>(layers);
+    });
+
+    // materials are deduplicated by comparing against every registered one
+    for (unsigned int i = 0; i < textureCount; i++)
+    {
+        GpuMaterial material;
+        material.diffuse.array = static_cast<int>(i);
+        library.AddMaterial(material);
+    }
+    measure("material_lookup", textureCount, [&]() {
+        unsigned int total = 0;
+        for (unsigned int i = 0; i < textureCount; i++)
+        {
+            GpuMaterial material;
+            material.diffuse.array = static_cast<int>(i);
+            total += library.AddMaterial(material);
+        }
+        sink = static_cast<float>(total);
+    });
+}
+
+// Shader's setters, each a uniform location lookup by name and a glUniform call
+static void benchmarkUniformSetters()
+{
+    string directory = "/tmp";
+    string vertexPath = directory + "/learnOpenGL_bench_vertex.glsl";
+    string fragmentPath = directory + "/learnOpenGL_bench_fragment.glsl";
+    ofstream(vertexPath) << "#version 330 core\n"
+                            "layout (location = 0) in vec3 aPos;\n"
+                            "uniform mat4 model;\n"
+                            "uniform mat4 view;\n"
+                            "uniform mat4 projection;\n"
+                            "void main() { gl_Position = projection * view * model * vec4(aPos, 1.0); }\n";
+    ofstream(fragmentPath) << "#version 330 core\n"
+                              "out vec4 FragColor;\n"
+                              "uniform vec3 color;\n"
+                              "uniform float intensity;\n"
+                              "uniform int enabled;\n"
+                              "void main() { FragColor = vec4(color * intensity * float(enabled), 1.0); }\n";
+    Shader shader(vertexPath.c_str(), fragmentPath.c_str());
+    remove(vertexPath.c_str());
+    remove(fragmentPath.c_str());
+    shader.use();
+
+    glm::mat4 matrix(1.0f);
+    measure("uniform_set_mat4", 1, [&]() { shader.setMat4("model", matrix); });
+    measure("uniform_set_vec3", 1, [&]() { shader.setVec3("color", 1.0f, 0.5f, 0.25f); });
+    measure("uniform_set_float", 1, [&]() { shader.setFloat("intensity", 0.5f); });
+    measure("uniform_set_int", 1, [&]() { shader.setInt("enabled", 1); });
+
+    // the same through GLInterceptor's wrappers, every set after the first redundant
+    GLInterceptor::SetEnabled(true);
+    measure("uniform_set_mat4_intercepted", 1, [&]() { shader.setMat4("model", matrix); });
+    measure("uniform_set_float_intercepted", 1, [&]() { shader.setFloat("intensity", 0.5f); });
+    GLInterceptor::SetEnabled(false);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            jsonOutput = true;
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else
+        {
+            cout << "usage: " << argv[0] << " [--json] [--filter text]" << endl;
+            return -1;
+        }
+    }
+
+    unsigned int hardwareThreads = max(1u, thread::hardware_concurrency());
+    {
+        JobSystem jobs;
+        benchmarkSpawn(jobs, 100000);
+        benchmarkSteal(jobs, 20000);
+        benchmarkDependencies(jobs, 10000);
+    }
+    benchmarkScaling(hardwareThreads, 100000, 1024);
+
+    benchmarkImportGeometry(256);
+    benchmarkCamera();
+    benchmarkFrustumCull(100000);
+    benchmarkBvh(100000);
+    benchmarkEntityUpdate(100000);
+    benchmarkOcclusion(16, 10000);
+    benchmarkProfileZone();
+
+#ifdef LEARNOPENGL_HEADLESS
+    HeadlessContext context;
+    if (context.IsValid() && gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+    {
+        benchmarkTextureLookup(1024);
+        benchmarkUniformSetters();
+    }
+    else
+        cout << "ERROR::BENCH:: no headless GL context, skipping the GL benchmarks" << endl;
+#else
+    cout << "ERROR::BENCH:: built without EGL, skipping the GL benchmarks" << endl;
+#endif
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "camera.h"
+#include "camera_path.h"
+#include "frame_pacer.h"
+#include "frame_timings.h"
+#include "input_recording.h"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+struct BenchmarkSettings {
+    unsigned int warmupFrames = 60; // rendered but not measured, lets caches, drivers and clocks settle
+    unsigned int frames = 1000;     // measured
+    float timestep = 1.0f / 60.0f;  // simulated seconds per frame, whatever the frames really take
+    string cameraPath;              // a CameraPath file, an orbit of the origin when neither this nor inputReplay is set
+    float orbitRadius = 4.0f;       // of the default orbit
+    float orbitHeight = 1.0f;
+    string inputReplay;             // an InputRecording to play back instead of a path
+    string report = "benchmark.json";
+};
+
+// Runs the renderer as a repeatable benchmark.
+//
+// The simulation steps by a fixed timestep and the camera follows a scripted path or replays recorded input, so
+// every run renders exactly the same frames and only their timings differ. Per measured frame it keeps the wall
+// time of the whole frame, the CPU time from the frame pacer and the GPU time between the pacer's timestamp
+// queries. Those arrive maxFramesInFlight frames late, so the run renders that many extra frames at the end for
+// the last measured ones to complete.
+//
+// Per frame: Collect() right after FramePacer::BeginFrame, Drive() in place of processing live input and
+// EndFrame() once the frame is swapped; stop when Finished().
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(const BenchmarkSettings &settings, unsigned int maxFramesInFlight)
+        : settings(settings), framesInFlight(maxFramesInFlight)
+    {
+        if (!settings.inputReplay.empty())
+            valid = replay.Load(settings.inputReplay);
+        else if (!settings.cameraPath.empty())
+            valid = path.Load(settings.cameraPath);
+        else
+            path = CameraPath::Orbit(glm::vec3(0.0f), settings.orbitRadius, settings.orbitHeight, 20.0f);
+    }
+
+    bool IsValid() const { return valid; }
+    bool Finished() const { return frame >= settings.warmupFrames + settings.frames + framesInFlight; }
+    float Timestep() const { return settings.timestep; }
+    unsigned int Frame() const { return frame; }
+
+    // the pacer has just completed the frame from maxFramesInFlight frames ago
+    void Collect(const FramePacingStats &completed)
+    {
+        if (frame < framesInFlight || !measured(frame - framesInFlight))
+            return;
+        cpuTimes.Add(completed.cpuMilliseconds);
+        gpuTimes.Add(completed.gpuMilliseconds);
+    }
+
+    // moves the camera for this frame, replayed input goes through the same code as live input
+    void Drive(Camera &camera, const function<void(const InputFrame &)> &applyInput)
+    {
+        if (!settings.inputReplay.empty())
+        {
+            applyInput(replay.Frame(frame));
+            return;
+        }
+        CameraKey key = path.Sample(frame * settings.timestep);
+        camera.SetPose(key.position, key.yaw, key.pitch);
+    }
+
+    void EndFrame(double frameMilliseconds)
+    {
+        if (measured(frame))
+            frameTimes.Add(frameMilliseconds);
+        frame++;
+    }
+
+    void Print() const
+    {
+        frameTimes.Print("benchmark frame");
+        cpuTimes.Print("benchmark cpu", false);
+        gpuTimes.Print("benchmark gpu", false);
+    }
+
+    // the summaries with histograms as JSON, to settings.report
+    bool WriteReport() const
+    {
+        ofstream file(settings.report);
+        if (!file)
+        {
+            cout << "ERROR::BENCHMARK:: can't write " << settings.report << endl;
+            return false;
+        }
+        file << "{\n  \"frames\": " << settings.frames << ",\n  \"warmupFrames\": " << settings.warmupFrames
+             << ",\n  \"timestep\": " << settings.timestep << ",\n  \"source\": \""
+             << (!settings.inputReplay.empty() ? "input" : "path") << "\",\n  \"frame\": ";
+        frameTimes.WriteJson(file, HISTOGRAM_BUCKET_MILLISECONDS, HISTOGRAM_BUCKETS);
+        file << ",\n  \"cpu\": ";
+        cpuTimes.WriteJson(file, HISTOGRAM_BUCKET_MILLISECONDS, HISTOGRAM_BUCKETS);
+        file << ",\n  \"gpu\": ";
+        gpuTimes.WriteJson(file, HISTOGRAM_BUCKET_MILLISECONDS, HISTOGRAM_BUCKETS);
+        file << "\n}\n";
+        cout << "benchmark: report written to " << settings.report << endl;
+        return true;
+    }
+
+private:
+    // a quarter millisecond apart up to 50ms, anything slower lands in the last bucket
+    static constexpr double HISTOGRAM_BUCKET_MILLISECONDS = 0.25;
+    static constexpr unsigned int HISTOGRAM_BUCKETS = 200;
+
+    BenchmarkSettings settings;
+    unsigned int framesInFlight;
+    bool valid = true;
+    CameraPath path;
+    InputRecording replay;
+    unsigned int frame = 0;
+    FrameTimings frameTimes, cpuTimes, gpuTimes;
+
+    bool measured(unsigned int index) const
+    {
+        return index >= settings.warmupFrames && index < settings.warmupFrames + settings.frames;
+    }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef BINDINGS_H
+#define BINDINGS_H
+
+// Every buffer binding point the renderer uses, in one place so no two blocks end up sharing one. The shaders
+// declare the same numbers in their layout(binding = N) qualifiers, change both together.
+
+// shader storage blocks
+#define MATERIAL_SSBO_BINDING 0      // the material table, shaders/material-arrays
+#define GPU_INSTANCES_BINDING 1      // shaders/gpu-culling
+#define GPU_MESHES_BINDING 2
+#define GPU_COMMANDS_BINDING 3
+#define GPU_DRAW_COUNT_BINDING 4
+#define SCENE_POINT_LIGHT_BINDING 5  // a stress scene's lights, shaders/material-arrays/fragment.glsl
+#define SCENE_SPOT_LIGHT_BINDING 6
+
+// uniform blocks, binding points of their own
+#define FRAME_UNIFORM_BINDING 1      // per-frame constants, the Frame block of the material-arrays and gpu-culling vertex shaders
+#define DRAW_UNIFORM_BINDING 2       // per-draw constants written by the render queue, see RenderQueue::DrawConstants
+
+#endif
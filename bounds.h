@@ -0,0 +1,84 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+
+// axis aligned bounding box, an empty box has min > max
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool IsEmpty() const { return min.x > max.x; }
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extents() const { return (max - min) * 0.5f; }
+
+    void Expand(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const AABB &other)
+    {
+        if (other.IsEmpty())
+            return;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // box around this box after an affine transform (Arvo's method: the extents are projected onto the
+    // transformed axes, which is exact for the box's corners and needs no per-corner work)
+    AABB Transformed(const glm::mat4 &transform) const
+    {
+        if (IsEmpty())
+            return *this;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 newExtents;
+        for (int i = 0; i < 3; i++)
+            newExtents[i] = std::fabs(transform[0][i]) * extents.x
+                          + std::fabs(transform[1][i]) * extents.y
+                          + std::fabs(transform[2][i]) * extents.z;
+        AABB result;
+        result.min = center - newExtents;
+        result.max = center + newExtents;
+        return result;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f;
+};
+
+// both bounding volumes of a piece of geometry, computed once at import
+struct Bounds {
+    AABB box;
+    BoundingSphere sphere;
+
+    // fits the box to the points, then a sphere around the box's center that still holds every point
+    template <typename Iterator, typename Position>
+    static Bounds FromPoints(Iterator begin, Iterator end, Position position)
+    {
+        Bounds bounds;
+        for (Iterator it = begin; it != end; ++it)
+            bounds.box.Expand(position(*it));
+        if (bounds.box.IsEmpty())
+            return bounds;
+
+        bounds.sphere.center = bounds.box.Center();
+        float radiusSquared = 0.0f;
+        for (Iterator it = begin; it != end; ++it)
+        {
+            glm::vec3 offset = position(*it) - bounds.sphere.center;
+            radiusSquared = std::fmax(radiusSquared, glm::dot(offset, offset));
+        }
+        bounds.sphere.radius = std::sqrt(radiusSquared);
+        return bounds;
+    }
+};
+
+#endif
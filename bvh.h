@@ -0,0 +1,407 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <numeric>
+#include <vector>
+
+using namespace std;
+
+// A node covers items[first, first + count). Children of inner nodes are stored next to each other at left and
+// left + 1, always after their parent, so a reverse walk over the array visits children before parents.
+struct BVHNode {
+    AABB bounds;
+    unsigned int left = 0;  // 0 for leaves, the root is never anyone's child
+    unsigned int first = 0;
+    unsigned int count = 0;
+
+    bool IsLeaf() const { return left == 0; }
+};
+
+// counters for the most recent Cull or Query
+struct BVHStats {
+    unsigned int nodesVisited = 0;
+    unsigned int itemsTested = 0;    // items tested one by one in partially visible leaves
+    unsigned int itemsAccepted = 0;  // items accepted with their whole subtree, without a test of their own
+    double microseconds = 0.0;
+};
+
+// Bounding volume hierarchy over instance bounds for scenes with many instances.
+//
+// Built top-down with a binned surface area heuristic. When instances move, Update() refits the existing tree,
+// which keeps it valid but slowly makes it worse; once the SAH cost has grown past REBUILD_THRESHOLD times what
+// it was at build time, a fresh tree is built on a background thread from a snapshot of the bounds and swapped in
+// by a later Update(). Frustum culling walks the tree with a mask of the planes still straddled, so subtrees
+// fully inside the frustum are accepted without testing anything below them.
+class SceneBVH {
+public:
+    static constexpr unsigned int MAX_LEAF_SIZE = 4;
+    static constexpr int BIN_COUNT = 16;
+    static constexpr float REBUILD_THRESHOLD = 1.3f;
+
+    // builds the tree synchronously, instance i is identified by index i everywhere else
+    void Build(const vector<AABB> &instanceBounds)
+    {
+        tree = buildTree(instanceBounds);
+        rebuilds++;
+    }
+
+    // per frame: takes a finished background rebuild, refits to the current bounds and starts a new rebuild when
+    // the tree has degraded. Adding or removing instances forces a synchronous build.
+    void Update(const vector<AABB> &instanceBounds)
+    {
+        if (pending.valid() && pending.wait_for(chrono::seconds(0)) == future_status::ready)
+        {
+            Tree rebuilt = pending.get();
+            if (rebuilt.bounds.size() == instanceBounds.size())
+            {
+                tree = std::move(rebuilt);
+                rebuilds++;
+            }
+        }
+        if (tree.bounds.size() != instanceBounds.size())
+        {
+            Build(instanceBounds);
+            return;
+        }
+
+        Refit(instanceBounds);
+        if (!pending.valid() && tree.cost > tree.builtCost * REBUILD_THRESHOLD)
+            pending = async(launch::async, buildTree, instanceBounds);
+    }
+
+    // updates every node's bounds bottom-up without changing the topology
+    void Refit(const vector<AABB> &instanceBounds)
+    {
+        tree.bounds = instanceBounds;
+        for (size_t i = tree.nodes.size(); i-- > 0;)
+        {
+            BVHNode &node = tree.nodes[i];
+            node.bounds = AABB();
+            if (node.IsLeaf())
+                for (unsigned int j = node.first; j < node.first + node.count; j++)
+                    node.bounds.Expand(tree.bounds[tree.items[j]]);
+            else
+            {
+                node.bounds.Expand(tree.nodes[node.left].bounds);
+                node.bounds.Expand(tree.nodes[node.left + 1].bounds);
+            }
+        }
+        tree.cost = sahCost(tree);
+        refits++;
+    }
+
+    // appends the indices of the instances intersecting the frustum to visible
+    void Cull(const Frustum &frustum, vector<unsigned int> &visible)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        stats = BVHStats();
+        if (tree.nodes.empty())
+            return;
+
+        const unsigned int allPlanes = (1u << Frustum::PLANE_COUNT) - 1u;
+        stack.clear();
+        stack.push_back({0, allPlanes});
+        while (!stack.empty())
+        {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+            const BVHNode &node = tree.nodes[entry.node];
+            stats.nodesVisited++;
+
+            unsigned int planes = classify(frustum, node.bounds, entry.planes);
+            if (planes == OUTSIDE)
+                continue;
+            if (planes == 0)
+            {
+                // fully inside: everything below is visible
+                emitRange(node, visible);
+                continue;
+            }
+            if (node.IsLeaf())
+            {
+                for (unsigned int j = node.first; j < node.first + node.count; j++)
+                {
+                    stats.itemsTested++;
+                    if (classify(frustum, tree.bounds[tree.items[j]], planes) != OUTSIDE)
+                        visible.push_back(tree.items[j]);
+                }
+                continue;
+            }
+            stack.push_back({node.left + 1, planes});
+            stack.push_back({node.left, planes});
+        }
+        stats.microseconds = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // appends the indices of the instances whose bounds overlap the box to result
+    void Query(const AABB &box, vector<unsigned int> &result)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        stats = BVHStats();
+        if (tree.nodes.empty())
+            return;
+
+        stack.clear();
+        stack.push_back({0, 0});
+        while (!stack.empty())
+        {
+            const BVHNode &node = tree.nodes[stack.back().node];
+            stack.pop_back();
+            stats.nodesVisited++;
+            if (!overlaps(node.bounds, box))
+                continue;
+            if (contains(box, node.bounds))
+            {
+                emitRange(node, result);
+                continue;
+            }
+            if (node.IsLeaf())
+            {
+                for (unsigned int j = node.first; j < node.first + node.count; j++)
+                {
+                    stats.itemsTested++;
+                    if (overlaps(tree.bounds[tree.items[j]], box))
+                        result.push_back(tree.items[j]);
+                }
+                continue;
+            }
+            stack.push_back({node.left + 1, 0});
+            stack.push_back({node.left, 0});
+        }
+        stats.microseconds = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const vector<BVHNode> &Nodes() const { return tree.nodes; }
+    const BVHStats &LastQueryStats() const { return stats; }
+    unsigned int RefitCount() const { return refits; }
+    unsigned int RebuildCount() const { return rebuilds; }
+    // current SAH cost relative to the cost right after the last build
+    float Degradation() const { return tree.builtCost > 0.0f ? tree.cost / tree.builtCost : 1.0f; }
+
+private:
+    struct Tree {
+        vector<BVHNode> nodes;
+        vector<unsigned int> items; // instance indices, each node covers a contiguous range
+        vector<AABB> bounds;        // per instance, as of the last build or refit
+        float cost = 0.0f;
+        float builtCost = 0.0f;
+    };
+
+    struct StackEntry {
+        unsigned int node;
+        unsigned int planes;
+    };
+
+    static constexpr unsigned int OUTSIDE = ~0u;
+
+    Tree tree;
+    future<Tree> pending;
+    vector<StackEntry> stack;
+    BVHStats stats;
+    unsigned int refits = 0;
+    unsigned int rebuilds = 0;
+
+    void emitRange(const BVHNode &node, vector<unsigned int> &out)
+    {
+        out.insert(out.end(), tree.items.begin() + node.first, tree.items.begin() + node.first + node.count);
+        stats.itemsAccepted += node.count;
+    }
+
+    // tests the box against the planes in the mask: OUTSIDE when it's behind any of them, otherwise the subset of
+    // planes it still straddles (0 means fully inside)
+    static unsigned int classify(const Frustum &frustum, const AABB &box, unsigned int planes)
+    {
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        for (int i = 0; i < Frustum::PLANE_COUNT; i++)
+        {
+            if (!(planes & (1u << i)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[i];
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+            if (distance + radius < 0.0f)
+                return OUTSIDE;
+            if (distance - radius >= 0.0f)
+                planes &= ~(1u << i);
+        }
+        return planes;
+    }
+
+    static bool overlaps(const AABB &a, const AABB &b)
+    {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x
+            && a.min.y <= b.max.y && a.max.y >= b.min.y
+            && a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+
+    static bool contains(const AABB &outer, const AABB &inner)
+    {
+        return outer.min.x <= inner.min.x && outer.max.x >= inner.max.x
+            && outer.min.y <= inner.min.y && outer.max.y >= inner.max.y
+            && outer.min.z <= inner.min.z && outer.max.z >= inner.max.z;
+    }
+
+    static float area(const AABB &box)
+    {
+        if (box.IsEmpty())
+            return 0.0f;
+        glm::vec3 size = box.max - box.min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // expected cost of a random ray-like query, relative to the root: traversal steps plus item tests
+    static float sahCost(const Tree &tree)
+    {
+        if (tree.nodes.empty())
+            return 0.0f;
+        float rootArea = area(tree.nodes[0].bounds);
+        if (rootArea <= 0.0f)
+            return 0.0f;
+        float cost = 0.0f;
+        for (const BVHNode &node : tree.nodes)
+            cost += area(node.bounds) / rootArea * (node.IsLeaf() ? static_cast<float>(node.count) : 1.0f);
+        return cost;
+    }
+
+    // top-down binned SAH build, static so it can run on a background thread with its own copy of the bounds
+    static Tree buildTree(vector<AABB> instanceBounds)
+    {
+        Tree tree;
+        tree.bounds = std::move(instanceBounds);
+        unsigned int n = static_cast<unsigned int>(tree.bounds.size());
+        if (n == 0)
+            return tree;
+
+        tree.items.resize(n);
+        iota(tree.items.begin(), tree.items.end(), 0u);
+        vector<glm::vec3> centroids(n);
+        for (unsigned int i = 0; i < n; i++)
+            centroids[i] = tree.bounds[i].Center();
+
+        tree.nodes.reserve(2 * n);
+        BVHNode root;
+        root.count = n;
+        tree.nodes.push_back(root);
+
+        vector<unsigned int> work{0};
+        while (!work.empty())
+        {
+            unsigned int index = work.back();
+            work.pop_back();
+            BVHNode node = tree.nodes[index];
+            for (unsigned int j = node.first; j < node.first + node.count; j++)
+                node.bounds.Expand(tree.bounds[tree.items[j]]);
+            tree.nodes[index].bounds = node.bounds;
+            if (node.count <= MAX_LEAF_SIZE)
+                continue;
+
+            unsigned int mid = split(tree, centroids, node);
+            if (mid == node.first || mid == node.first + node.count)
+                continue;
+
+            BVHNode left, right;
+            left.first = node.first;
+            left.count = mid - node.first;
+            right.first = mid;
+            right.count = node.first + node.count - mid;
+            tree.nodes[index].left = static_cast<unsigned int>(tree.nodes.size());
+            tree.nodes.push_back(left);
+            tree.nodes.push_back(right);
+            work.push_back(tree.nodes[index].left);
+            work.push_back(tree.nodes[index].left + 1);
+        }
+
+        tree.cost = tree.builtCost = sahCost(tree);
+        return tree;
+    }
+
+    // partitions the node's items around the cheapest of BIN_COUNT - 1 candidate planes per axis and returns the
+    // first item of the right half, or the node's end when keeping it as a leaf is cheaper
+    static unsigned int split(Tree &tree, const vector<glm::vec3> &centroids, const BVHNode &node)
+    {
+        AABB centroidBounds;
+        for (unsigned int j = node.first; j < node.first + node.count; j++)
+            centroidBounds.Expand(centroids[tree.items[j]]);
+
+        float bestCost = area(node.bounds) * static_cast<float>(node.count); // cost of staying a leaf
+        int bestAxis = -1, bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float lo = centroidBounds.min[axis], extent = centroidBounds.max[axis] - lo;
+            if (extent <= 0.0f)
+                continue;
+            float scale = BIN_COUNT / extent;
+
+            AABB binBounds[BIN_COUNT];
+            unsigned int binCounts[BIN_COUNT] = {};
+            for (unsigned int j = node.first; j < node.first + node.count; j++)
+            {
+                unsigned int item = tree.items[j];
+                int bin = min(BIN_COUNT - 1, static_cast<int>((centroids[item][axis] - lo) * scale));
+                binBounds[bin].Expand(tree.bounds[item]);
+                binCounts[bin]++;
+            }
+
+            // sweep from the right to get the right-hand cost of each plane, then from the left to combine
+            float rightArea[BIN_COUNT];
+            unsigned int rightCount[BIN_COUNT];
+            AABB sweep;
+            unsigned int count = 0;
+            for (int bin = BIN_COUNT - 1; bin > 0; bin--)
+            {
+                sweep.Expand(binBounds[bin]);
+                count += binCounts[bin];
+                rightArea[bin] = area(sweep);
+                rightCount[bin] = count;
+            }
+            sweep = AABB();
+            count = 0;
+            for (int bin = 0; bin < BIN_COUNT - 1; bin++)
+            {
+                sweep.Expand(binBounds[bin]);
+                count += binCounts[bin];
+                float cost = area(sweep) * count + rightArea[bin + 1] * rightCount[bin + 1];
+                if (count > 0 && rightCount[bin + 1] > 0 && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        // leaves are capped at MAX_LEAF_SIZE, so when no plane beats the leaf cost split at the median instead;
+        // only items whose centroids all coincide end up in a larger leaf
+        unsigned int *begin = tree.items.data() + node.first, *end = begin + node.count;
+        if (bestAxis < 0)
+        {
+            int axis = 0;
+            glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+            if (extent.y > extent[axis]) axis = 1;
+            if (extent.z > extent[axis]) axis = 2;
+            if (extent[axis] <= 0.0f)
+                return node.first + node.count;
+            unsigned int *middle = begin + node.count / 2;
+            nth_element(begin, middle, end, [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+            return static_cast<unsigned int>(middle - tree.items.data());
+        }
+
+        float lo = centroidBounds.min[bestAxis];
+        float scale = BIN_COUNT / (centroidBounds.max[bestAxis] - lo);
+        unsigned int *middle = partition(begin, end, [&](unsigned int item) {
+            return min(BIN_COUNT - 1, static_cast<int>((centroids[item][bestAxis] - lo) * scale)) <= bestBin;
+        });
+        return static_cast<unsigned int>(middle - tree.items.data());
+    }
+};
+
+#endif
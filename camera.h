@@ -117,6 +117,15 @@ public:
             Zoom = 45.0f;
     }
 
+    // places the camera outright, e.g. from a scripted path. Angles are in degrees like Yaw and Pitch.
+    void SetPose(glm::vec3 position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
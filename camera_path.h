@@ -0,0 +1,129 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// where the camera is at a point in time, angles in degrees like Camera's. Yaw isn't wrapped, so a key at 350
+// followed by one at 370 turns 20 degrees rather than back round the long way.
+struct CameraKey {
+    float time;
+    glm::vec3 position;
+    float yaw, pitch;
+};
+
+// A scripted camera flight: keys in time order, interpolated with a Catmull-Rom spline so the camera passes
+// through every key without stopping or kinking at it. Sampling past the end starts the path over.
+//
+// Paths load from text files with a "time x y z yaw pitch" line per key, # starts a comment.
+class CameraPath {
+public:
+    // keys have to be added in time order
+    void AddKey(float time, glm::vec3 position, float yaw, float pitch)
+    {
+        if (!keys.empty() && time <= keys.back().time)
+        {
+            cout << "ERROR::CAMERA_PATH:: key at " << time << "s isn't after the previous key" << endl;
+            return;
+        }
+        keys.push_back(CameraKey{time, position, yaw, pitch});
+    }
+
+    bool Load(const string &path)
+    {
+        ifstream file(path);
+        if (!file)
+        {
+            cout << "ERROR::CAMERA_PATH:: can't read " << path << endl;
+            return false;
+        }
+        keys.clear();
+        string line;
+        for (unsigned int number = 1; getline(file, line); number++)
+        {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == string::npos)
+                continue;
+            istringstream fields(line);
+            CameraKey key;
+            if (!(fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch))
+            {
+                cout << "ERROR::CAMERA_PATH:: bad key on line " << number << " of " << path << endl;
+                return false;
+            }
+            AddKey(key.time, key.position, key.yaw, key.pitch);
+        }
+        if (keys.size() < 2)
+        {
+            cout << "ERROR::CAMERA_PATH:: " << path << " needs at least two keys" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // once round a circle at the given height, always looking at the center
+    static CameraPath Orbit(glm::vec3 center, float radius, float height, float seconds, unsigned int keyCount = 16)
+    {
+        CameraPath path;
+        float pitch = glm::degrees(atan2f(-height, radius));
+        for (unsigned int i = 0; i <= keyCount; i++)
+        {
+            float angle = 360.0f * i / keyCount;
+            glm::vec3 position = center + glm::vec3(radius * cosf(glm::radians(angle)), height, radius * sinf(glm::radians(angle)));
+            path.AddKey(seconds * i / keyCount, position, angle + 180.0f, pitch);
+        }
+        return path;
+    }
+
+    size_t Size() const { return keys.size(); }
+    float Duration() const { return keys.empty() ? 0.0f : keys.back().time; }
+
+    CameraKey Sample(float time) const
+    {
+        if (keys.empty())
+            return CameraKey{time, glm::vec3(0.0f), -90.0f, 0.0f};
+        if (keys.size() == 1 || Duration() <= 0.0f)
+            return keys.front();
+        time = fmodf(max(time, 0.0f), Duration());
+
+        // the segment the time falls in, keys[segment] to keys[segment + 1]
+        size_t segment = 0;
+        while (segment + 2 < keys.size() && keys[segment + 1].time <= time)
+            segment++;
+        const CameraKey &k1 = keys[segment];
+        const CameraKey &k2 = keys[segment + 1];
+        // the ends repeat their key so the spline still reaches them
+        const CameraKey &k0 = segment > 0 ? keys[segment - 1] : k1;
+        const CameraKey &k3 = segment + 2 < keys.size() ? keys[segment + 2] : k2;
+        float t = (time - k1.time) / (k2.time - k1.time);
+
+        CameraKey sample;
+        sample.time = time;
+        sample.position = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+        sample.yaw = catmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, t);
+        sample.pitch = glm::clamp(catmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, t), -89.0f, 89.0f);
+        return sample;
+    }
+
+private:
+    vector<CameraKey> keys;
+
+    template <typename T>
+    static T catmullRom(const T &p0, const T &p1, const T &p2, const T &p3, float t)
+    {
+        float t2 = t * t, t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+                       + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+};
+
+#endif
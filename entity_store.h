@@ -0,0 +1,309 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "bounds.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// refers to an entity for as long as it lives. The generation changes when the slot is reused, so a handle to a
+// destroyed entity never silently refers to whatever took its place.
+struct EntityHandle {
+    uint32_t slot = ~0u;
+    uint32_t generation = 0;
+
+    bool operator==(const EntityHandle &other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const EntityHandle &other) const { return !(*this == other); }
+};
+
+// Scene objects stored as structure of arrays.
+//
+// Every per-entity value is one float channel, and all channels are dense: live entities are [0, Size()) with
+// no holes, destroying one moves the last entity into its place. Handles go through a slot table to find the
+// dense index. Update() composes position, rotation (a quaternion) and scale into the world matrix channels and
+// transforms each entity's local box into world bounds, 4 entities per SSE2 instruction, in chunks spread over
+// the job system's workers. The world matrix is kept as its top three rows, the last row of an affine transform
+// is always (0, 0, 0, 1).
+class EntityStore {
+public:
+    enum Channel {
+        POSITION_X, POSITION_Y, POSITION_Z,
+        ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+        SCALE_X, SCALE_Y, SCALE_Z,
+        LOCAL_CENTER_X, LOCAL_CENTER_Y, LOCAL_CENTER_Z,
+        LOCAL_EXTENT_X, LOCAL_EXTENT_Y, LOCAL_EXTENT_Z,
+        // WORLD_rc is row r, column c
+        WORLD_00, WORLD_01, WORLD_02, WORLD_03,
+        WORLD_10, WORLD_11, WORLD_12, WORLD_13,
+        WORLD_20, WORLD_21, WORLD_22, WORLD_23,
+        BOUNDS_MIN_X, BOUNDS_MIN_Y, BOUNDS_MIN_Z,
+        BOUNDS_MAX_X, BOUNDS_MAX_Y, BOUNDS_MAX_Z,
+        CHANNEL_COUNT
+    };
+
+    // entities per parallel task, a multiple of the SIMD width
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    // without a job system Update() runs the chunks in turn
+    explicit EntityStore(JobSystem *jobs = nullptr) : jobs(jobs) {}
+
+    // adds an entity, its world matrix and bounds are valid after the next Update()
+    EntityHandle Create(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale,
+                        const AABB &localBounds, unsigned int renderable)
+    {
+        EntityHandle handle;
+        if (freeSlots.empty())
+        {
+            handle.slot = static_cast<uint32_t>(slots.size());
+            slots.push_back(0);
+            generations.push_back(0);
+        }
+        else
+        {
+            handle.slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        handle.generation = generations[handle.slot];
+        slots[handle.slot] = static_cast<uint32_t>(owners.size());
+        owners.push_back(handle.slot);
+        renderables.push_back(renderable);
+        for (vector<float> &channel : channels)
+            channel.push_back(0.0f);
+
+        size_t index = owners.size() - 1;
+        set(index, POSITION_X, position);
+        set(index, ROTATION_X, glm::vec3(rotation.x, rotation.y, rotation.z));
+        channels[ROTATION_W][index] = rotation.w;
+        set(index, SCALE_X, scale);
+        set(index, LOCAL_CENTER_X, localBounds.Center());
+        set(index, LOCAL_EXTENT_X, localBounds.Extents());
+        return handle;
+    }
+
+    // removes the entity, the last entity takes its dense index
+    void Destroy(EntityHandle handle)
+    {
+        if (!IsAlive(handle))
+            return;
+        size_t index = slots[handle.slot], last = owners.size() - 1;
+        for (vector<float> &channel : channels)
+        {
+            channel[index] = channel[last];
+            channel.pop_back();
+        }
+        renderables[index] = renderables[last];
+        renderables.pop_back();
+        owners[index] = owners[last];
+        owners.pop_back();
+        if (index != last)
+            slots[owners[index]] = static_cast<uint32_t>(index);
+
+        generations[handle.slot]++;
+        freeSlots.push_back(handle.slot);
+    }
+
+    bool IsAlive(EntityHandle handle) const
+    {
+        return handle.slot < slots.size() && generations[handle.slot] == handle.generation;
+    }
+
+    // dense index of a live entity, valid until the next Destroy()
+    size_t IndexOf(EntityHandle handle) const
+    {
+        assert(IsAlive(handle));
+        return slots[handle.slot];
+    }
+
+    // the setters do nothing for a destroyed entity's handle
+    void SetPosition(EntityHandle handle, const glm::vec3 &position)
+    {
+        if (IsAlive(handle))
+            set(slots[handle.slot], POSITION_X, position);
+    }
+
+    void SetScale(EntityHandle handle, const glm::vec3 &scale)
+    {
+        if (IsAlive(handle))
+            set(slots[handle.slot], SCALE_X, scale);
+    }
+
+    void SetRotation(EntityHandle handle, const glm::quat &rotation)
+    {
+        if (!IsAlive(handle))
+            return;
+        size_t index = slots[handle.slot];
+        set(index, ROTATION_X, glm::vec3(rotation.x, rotation.y, rotation.z));
+        channels[ROTATION_W][index] = rotation.w;
+    }
+
+    // recomputes every world matrix and world box
+    void Update()
+    {
+        auto start = chrono::high_resolution_clock::now();
+        auto updateChunk = [this](size_t begin, size_t end) {
+            composeTransforms(begin, end);
+            updateBounds(begin, end);
+        };
+        if (jobs)
+            jobs->ParallelFor(Size(), CHUNK_SIZE, updateChunk);
+        else
+            for (size_t begin = 0; begin < Size(); begin += CHUNK_SIZE)
+                updateChunk(begin, min(Size(), begin + CHUNK_SIZE));
+        lastUpdateMicroseconds = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    size_t Size() const { return owners.size(); }
+    // a channel for every live entity, by dense index, for bulk reads and writes
+    float *Data(Channel channel) { return channels[channel].data(); }
+    const float *Data(Channel channel) const { return channels[channel].data(); }
+    unsigned int Renderable(size_t index) const { return renderables[index]; }
+    EntityHandle Handle(size_t index) const { return EntityHandle{owners[index], generations[owners[index]]}; }
+    double LastUpdateMicroseconds() const { return lastUpdateMicroseconds; }
+
+    glm::mat4 World(size_t index) const
+    {
+        glm::mat4 world(1.0f);
+        for (int row = 0; row < 3; row++)
+            for (int column = 0; column < 4; column++)
+                world[column][row] = channels[WORLD_00 + row * 4 + column][index];
+        return world;
+    }
+
+    AABB Bounds(size_t index) const
+    {
+        AABB box;
+        box.min = get(index, BOUNDS_MIN_X);
+        box.max = get(index, BOUNDS_MAX_X);
+        return box;
+    }
+
+private:
+    vector<float> channels[CHANNEL_COUNT];
+    vector<unsigned int> renderables;
+    vector<uint32_t> owners;      // dense index -> slot
+    vector<uint32_t> slots;       // slot -> dense index
+    vector<uint32_t> generations; // slot -> generation
+    vector<uint32_t> freeSlots;
+    JobSystem *jobs;
+    double lastUpdateMicroseconds = 0.0;
+
+    void set(size_t index, int first, const glm::vec3 &value)
+    {
+        for (int i = 0; i < 3; i++)
+            channels[first + i][index] = value[i];
+    }
+
+    glm::vec3 get(size_t index, int first) const
+    {
+        return glm::vec3(channels[first][index], channels[first + 1][index], channels[first + 2][index]);
+    }
+
+    // world = translate * rotate * scale, the rotation matrix from the unit quaternion (x, y, z, w) with each
+    // column scaled by its axis' scale
+    void composeTransforms(size_t begin, size_t end)
+    {
+        const float *px = Data(POSITION_X), *py = Data(POSITION_Y), *pz = Data(POSITION_Z);
+        const float *qx = Data(ROTATION_X), *qy = Data(ROTATION_Y), *qz = Data(ROTATION_Z), *qw = Data(ROTATION_W);
+        const float *sx = Data(SCALE_X), *sy = Data(SCALE_Y), *sz = Data(SCALE_Z);
+        float *m[12];
+        for (int i = 0; i < 12; i++)
+            m[i] = Data(static_cast<Channel>(WORLD_00 + i));
+
+        size_t i = begin;
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(qx + i), y = _mm_loadu_ps(qy + i), z = _mm_loadu_ps(qz + i), w = _mm_loadu_ps(qw + i);
+            __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+            __m128 scaleX = _mm_loadu_ps(sx + i), scaleY = _mm_loadu_ps(sy + i), scaleZ = _mm_loadu_ps(sz + i);
+
+            _mm_storeu_ps(m[0] + i, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX));
+            _mm_storeu_ps(m[1] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY));
+            _mm_storeu_ps(m[2] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ));
+            _mm_storeu_ps(m[3] + i, _mm_loadu_ps(px + i));
+            _mm_storeu_ps(m[4] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX));
+            _mm_storeu_ps(m[5] + i, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY));
+            _mm_storeu_ps(m[6] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ));
+            _mm_storeu_ps(m[7] + i, _mm_loadu_ps(py + i));
+            _mm_storeu_ps(m[8] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX));
+            _mm_storeu_ps(m[9] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY));
+            _mm_storeu_ps(m[10] + i, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ));
+            _mm_storeu_ps(m[11] + i, _mm_loadu_ps(pz + i));
+        }
+#endif
+        for (; i < end; i++)
+        {
+            float x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+            m[0][i] = (1.0f - 2.0f * (y * y + z * z)) * sx[i];
+            m[1][i] = 2.0f * (x * y - w * z) * sy[i];
+            m[2][i] = 2.0f * (x * z + w * y) * sz[i];
+            m[3][i] = px[i];
+            m[4][i] = 2.0f * (x * y + w * z) * sx[i];
+            m[5][i] = (1.0f - 2.0f * (x * x + z * z)) * sy[i];
+            m[6][i] = 2.0f * (y * z - w * x) * sz[i];
+            m[7][i] = py[i];
+            m[8][i] = 2.0f * (x * z - w * y) * sx[i];
+            m[9][i] = 2.0f * (y * z + w * x) * sy[i];
+            m[10][i] = (1.0f - 2.0f * (x * x + y * y)) * sz[i];
+            m[11][i] = pz[i];
+        }
+    }
+
+    // the same projection of the extents onto the transformed axes as AABB::Transformed, per row of the matrix
+    void updateBounds(size_t begin, size_t end)
+    {
+        const float *cx = Data(LOCAL_CENTER_X), *cy = Data(LOCAL_CENTER_Y), *cz = Data(LOCAL_CENTER_Z);
+        const float *ex = Data(LOCAL_EXTENT_X), *ey = Data(LOCAL_EXTENT_Y), *ez = Data(LOCAL_EXTENT_Z);
+        for (int row = 0; row < 3; row++)
+        {
+            const float *m0 = Data(static_cast<Channel>(WORLD_00 + row * 4));
+            const float *m1 = Data(static_cast<Channel>(WORLD_01 + row * 4));
+            const float *m2 = Data(static_cast<Channel>(WORLD_02 + row * 4));
+            const float *m3 = Data(static_cast<Channel>(WORLD_03 + row * 4));
+            float *minimum = Data(static_cast<Channel>(BOUNDS_MIN_X + row));
+            float *maximum = Data(static_cast<Channel>(BOUNDS_MAX_X + row));
+
+            size_t i = begin;
+#if defined(__SSE2__) || defined(_M_X64)
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 a = _mm_loadu_ps(m0 + i), b = _mm_loadu_ps(m1 + i), c = _mm_loadu_ps(m2 + i);
+                __m128 center = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(cx + i)), _mm_mul_ps(b, _mm_loadu_ps(cy + i))),
+                                           _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(cz + i)), _mm_loadu_ps(m3 + i)));
+                __m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(a, absMask), _mm_loadu_ps(ex + i)),
+                                                      _mm_mul_ps(_mm_and_ps(b, absMask), _mm_loadu_ps(ey + i))),
+                                           _mm_mul_ps(_mm_and_ps(c, absMask), _mm_loadu_ps(ez + i)));
+                _mm_storeu_ps(minimum + i, _mm_sub_ps(center, extent));
+                _mm_storeu_ps(maximum + i, _mm_add_ps(center, extent));
+            }
+#endif
+            for (; i < end; i++)
+            {
+                float center = m0[i] * cx[i] + m1[i] * cy[i] + m2[i] * cz[i] + m3[i];
+                float extent = std::fabs(m0[i]) * ex[i] + std::fabs(m1[i]) * ey[i] + std::fabs(m2[i]) * ez[i];
+                minimum[i] = center - extent;
+                maximum[i] = center + extent;
+            }
+        }
+    }
+};
+
+#endif
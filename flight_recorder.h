@@ -0,0 +1,265 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "gl_interceptor.h"
+#include "metrics.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Keeps the last seconds of frames in memory and writes a trace of any frame that goes over budget, for the hitches
+// that never happen while anyone is profiling.
+//
+// The profiler records all the time, its per-thread rings already hold the last few seconds of zones. On top of
+// that the recorder keeps a ring of frames: when each started and ended, every metric's value for it and the GL
+// interceptor's totals when that's on. A frame longer than the budget triggers a trace of the window around it, the
+// windowSeconds before it and a second after, written once that second has passed: the zones of every thread, the
+// GPU passes, a counter track per metric and the slow frames marked on a track of their own. Each mark says why the
+// frame was slow as far as can be told, where the main thread's time went by zone, the counters far above the
+// frames before it, and the GL calls that took longest in the driver. The same goes to stdout.
+//
+// Per frame that's a copy of the metrics into the ring, the cost of leaving it on is the profiler's own. Slow
+// frames within a trace's window all go into that trace, and after MAX_TRACES the recorder stops writing.
+//
+// Usage: construct once, BeginFrame() at the top of every frame and EndFrame() after Metrics::EndFrame. Main
+// thread only.
+class FlightRecorder {
+public:
+    static constexpr unsigned int FRAME_CAPACITY = 1024;
+    static constexpr unsigned int MAX_METRICS = 32;
+    static constexpr unsigned int MAX_TRACES = 16;
+    // slow frames in one trace that get a cause, the rest are only marked
+    static constexpr unsigned int MAX_EXPLAINED = 8;
+    static constexpr double AFTER_SECONDS = 1.0;
+
+    FlightRecorder(double budgetMilliseconds, double windowSeconds = 5.0, const string &pathPrefix = "slow_frame")
+        : budget(budgetMilliseconds), window(static_cast<uint64_t>(windowSeconds * 1.0e9)), prefix(pathPrefix), frames(FRAME_CAPACITY)
+    {
+        Profiler::SetEnabled(true);
+    }
+
+    FlightRecorder(const FlightRecorder &) = delete;
+    FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+    void BeginFrame() { frameStart = Profiler::Now(); }
+
+    void EndFrame()
+    {
+        Frame &frame = frames[recorded % FRAME_CAPACITY];
+        frame.number = recorded++;
+        frame.start = frameStart;
+        frame.end = Profiler::Now();
+        frame.metricCount = 0;
+        Metrics::ForEach([&frame](const Metric &metric) {
+            if (frame.metricCount < MAX_METRICS)
+                frame.metrics[frame.metricCount++] = metric.LastFrame();
+        });
+        frame.gl = GLInterceptor::IsEnabled();
+        if (frame.gl)
+        {
+            const GLFrameStats &stats = GLInterceptor::LastFrameStats();
+            frame.glCalls = stats.calls;
+            frame.glNanoseconds = stats.nanoseconds;
+            frame.glBytesUploaded = stats.bytesUploaded;
+        }
+
+        double milliseconds = (frame.end - frame.start) / 1.0e6;
+        // the frame after a trace was written pays for the writing
+        bool afterTrace = skipNext;
+        skipNext = false;
+        if (milliseconds > budget && !afterTrace && traces < MAX_TRACES)
+            slowFrames.push_back(SlowFrame{frame.number, frame.start, frame.end, milliseconds,
+                                           slowFrames.size() < MAX_EXPLAINED ? cause(frame) : string()});
+        if (!slowFrames.empty() && frame.end - slowFrames.front().end >= static_cast<uint64_t>(AFTER_SECONDS * 1.0e9))
+            Flush();
+    }
+
+    // writes the trace of any slow frames now rather than a second after them, e.g. on exit
+    void Flush()
+    {
+        if (slowFrames.empty())
+            return;
+        const SlowFrame &first = slowFrames.front();
+        uint64_t from = first.start - min(first.start, window);
+        string path = prefix + "_" + to_string(++traces) + ".json";
+        for (const SlowFrame &slow : slowFrames)
+            if (!slow.cause.empty())
+                cout << "flight recorder: frame " << slow.number << " took " << fixed << setprecision(1) << slow.milliseconds
+                     << "ms of a " << budget << "ms budget" << defaultfloat << setprecision(6) << ", " << slow.cause << endl;
+        if (slowFrames.size() > MAX_EXPLAINED)
+            cout << "flight recorder: " << slowFrames.size() - MAX_EXPLAINED << " more slow frames" << endl;
+        Profiler::WriteTrace(path, from, Profiler::Now(), traceEvents(from));
+        if (traces == MAX_TRACES)
+            cout << "flight recorder: " << MAX_TRACES << " traces written, not writing more" << endl;
+        slowFrames.clear();
+        skipNext = true;
+    }
+
+private:
+    struct Frame {
+        uint64_t number = 0;
+        uint64_t start = 0, end = 0; // profiler time
+        double metrics[MAX_METRICS];
+        unsigned int metricCount = 0;
+        bool gl = false;
+        unsigned int glCalls = 0;
+        uint64_t glNanoseconds = 0;
+        uint64_t glBytesUploaded = 0;
+    };
+
+    struct SlowFrame {
+        uint64_t number;
+        uint64_t start, end;
+        double milliseconds;
+        string cause;
+    };
+
+    const double budget;
+    const uint64_t window;
+    const string prefix;
+    vector<Frame> frames;
+    uint64_t recorded = 0;
+    uint64_t frameStart = 0;
+    vector<SlowFrame> slowFrames; // waiting for the second after the first of them
+    unsigned int traces = 0;
+    bool skipNext = false;
+
+    // the frame with that number if the ring still has it
+    const Frame *find(uint64_t number) const
+    {
+        if (number >= recorded || recorded - number > FRAME_CAPACITY)
+            return nullptr;
+        return &frames[number % FRAME_CAPACITY];
+    }
+
+    string cause(const Frame &frame) const
+    {
+        ostringstream text;
+        text << fixed << setprecision(1);
+
+        // where the main thread's time went: each zone's own time, without the zones inside it
+        vector<ProfileEvent> events = Profiler::ThreadEvents(frame.start, frame.end);
+        events.erase(remove_if(events.begin(), events.end(), [&frame](const ProfileEvent &event) {
+            return event.start < frame.start || event.start + event.duration > frame.end;
+        }), events.end());
+        sort(events.begin(), events.end(), [](const ProfileEvent &a, const ProfileEvent &b) {
+            return a.start != b.start ? a.start < b.start : a.duration > b.duration;
+        });
+        map<const ProfileZone*, uint64_t> self;
+        vector<const ProfileEvent*> open;
+        uint64_t covered = 0;
+        for (const ProfileEvent &event : events)
+        {
+            while (!open.empty() && open.back()->start + open.back()->duration <= event.start)
+                open.pop_back();
+            if (open.empty())
+                covered += event.duration;
+            else
+                self[open.back()->zone] -= event.duration;
+            self[event.zone] += event.duration;
+            open.push_back(&event);
+        }
+        vector<pair<uint64_t, string>> zones;
+        for (const auto &zone : self)
+            zones.push_back({zone.second, zone.first->name});
+        uint64_t untracked = frame.end - frame.start - min(frame.end - frame.start, covered);
+        if (untracked > 0)
+            zones.push_back({untracked, "no zone"});
+        sort(zones.begin(), zones.end(), greater<pair<uint64_t, string>>());
+        text << "most time in";
+        for (size_t i = 0; i < zones.size() && i < 3; i++)
+            text << (i > 0 ? ", " : " ") << zones[i].second << " " << zones[i].first / 1.0e6 << "ms";
+
+        // counters far above the frames before
+        vector<const char*> names;
+        vector<bool> counters;
+        Metrics::ForEach([&names, &counters](const Metric &metric) {
+            names.push_back(metric.name);
+            counters.push_back(metric.counter);
+        });
+        const unsigned int history = 60;
+        for (unsigned int i = 0; i < frame.metricCount && i < names.size(); i++)
+        {
+            if (!counters[i])
+                continue;
+            double sum = 0.0;
+            unsigned int count = 0;
+            for (uint64_t number = frame.number - min<uint64_t>(frame.number, history); number < frame.number; number++)
+                if (const Frame *before = find(number))
+                {
+                    sum += before->metrics[i];
+                    count++;
+                }
+            double average = count > 0 ? sum / count : 0.0;
+            double value = frame.metrics[i];
+            if (average == 0.0 && value > 0.0 && count > 0)
+                text << "; " << names[i] << " " << setprecision(0) << value << ", none in the frames before" << setprecision(1);
+            else if (average > 0.0 && value >= 4.0 * average)
+                text << "; " << names[i] << " " << setprecision(0) << value << ", " << value / average << "x the average" << setprecision(1);
+        }
+
+        // the interceptor's view, when it's on
+        if (frame.gl)
+        {
+            const GLFrameStats &stats = GLInterceptor::LastFrameStats();
+            unsigned int slowest = 0;
+            for (unsigned int i = 1; i < GL_ENTRY_COUNT; i++)
+                if (stats.entries[i].nanoseconds > stats.entries[slowest].nanoseconds)
+                    slowest = i;
+            text << "; " << stats.calls << " GL calls " << stats.DriverMilliseconds() << "ms in the driver, most in "
+                 << GLInterceptor::EntryName(slowest) << " " << stats.entries[slowest].nanoseconds / 1.0e6 << "ms";
+        }
+        return text.str();
+    }
+
+    // the slow frames' marks and a counter track per metric, for Profiler::WriteTrace
+    string traceEvents(uint64_t from) const
+    {
+        ostringstream events;
+        events << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"slow frames\"}}";
+        for (const SlowFrame &slow : slowFrames)
+        {
+            ostringstream args;
+            args << "{\"frame\": " << slow.number << ", \"milliseconds\": " << slow.milliseconds << ", \"budget_milliseconds\": " << budget;
+            if (!slow.cause.empty())
+                args << ", \"cause\": \"" << Profiler::EscapeJson(slow.cause) << "\"";
+            args << "}";
+            events << ",\n{\"ph\": \"X\", \"name\": \"slow frame\", \"pid\": 1, \"tid\": 0, \"ts\": " << Profiler::TraceTime(slow.start)
+                   << ", \"dur\": " << Profiler::TraceTime(slow.end - slow.start) << ", \"args\": " << args.str() << "}"
+                   << ",\n{\"ph\": \"i\", \"s\": \"g\", \"name\": \"slow frame\", \"pid\": 1, \"tid\": 0, \"ts\": "
+                   << Profiler::TraceTime(slow.start) << ", \"args\": " << args.str() << "}";
+        }
+
+        vector<const char*> names;
+        Metrics::ForEach([&names](const Metric &metric) { names.push_back(metric.name); });
+        events.precision(12);
+        for (uint64_t number = recorded - min<uint64_t>(recorded, FRAME_CAPACITY); number < recorded; number++)
+        {
+            const Frame &frame = frames[number % FRAME_CAPACITY];
+            if (frame.start < from)
+                continue;
+            string time = Profiler::TraceTime(frame.start);
+            for (unsigned int i = 0; i < frame.metricCount && i < names.size(); i++)
+                events << ",\n{\"ph\": \"C\", \"name\": \"" << names[i] << "\", \"pid\": 1, \"ts\": " << time
+                       << ", \"args\": {\"value\": " << frame.metrics[i] << "}}";
+            if (frame.gl)
+                events << ",\n{\"ph\": \"C\", \"name\": \"gl_calls\", \"pid\": 1, \"ts\": " << time << ", \"args\": {\"value\": " << frame.glCalls << "}}"
+                       << ",\n{\"ph\": \"C\", \"name\": \"gl_driver_milliseconds\", \"pid\": 1, \"ts\": " << time
+                       << ", \"args\": {\"value\": " << frame.glNanoseconds / 1.0e6 << "}}"
+                       << ",\n{\"ph\": \"C\", \"name\": \"gl_uploaded_bytes\", \"pid\": 1, \"ts\": " << time
+                       << ", \"args\": {\"value\": " << frame.glBytesUploaded << "}}";
+        }
+        return events.str();
+    }
+};
+
+#endif
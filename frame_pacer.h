@@ -0,0 +1,163 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// timings of the most recent frame whose GPU work has completed, in milliseconds
+struct FramePacingStats {
+    double cpuMilliseconds = 0.0;         // BeginFrame returning to EndFrame
+    double gpuMilliseconds = 0.0;         // GPU timestamps at BeginFrame returning and at EndFrame
+    double fenceWaitMilliseconds = 0.0;   // blocked because too many frames were in flight
+    double sleepMilliseconds = 0.0;       // slept towards the frame's deadline
+    double submitLatencyMilliseconds = 0.0; // EndFrame to the GPU finishing the frame
+    double inputLatencyMilliseconds = 0.0;  // input sampling (BeginFrame returning) to the GPU finishing the frame
+};
+
+// Keeps the CPU from running ahead of the GPU and spaces frames out evenly.
+//
+// Per frame: BeginFrame() right before polling input, EndFrame() right before swapping. EndFrame places a fence
+// and a GPU timestamp; BeginFrame waits on the fence from maxFramesInFlight frames ago, so the driver never queues
+// more than that many frames, however it handles swaps. With an FPS cap frames start on a fixed cadence, and with
+// late input sampling BeginFrame sleeps until just before the deadline less the CPU time the frame is expected to
+// take, so input is read as late as possible. Sleeping stops a little early and spins the rest, because sleeps
+// overshoot. Latency is measured on the GPU clock: glGetInteger64v(GL_TIMESTAMP) reads it when input is sampled
+// and at submission, and the timestamp query tells when the GPU actually got to the end of the frame. A second
+// timestamp query at the start of the frame gives the GPU time between the two.
+class FramePacer {
+public:
+    // fpsCap of 0 leaves the cadence to vsync or to the GPU
+    explicit FramePacer(unsigned int maxFramesInFlight = 2, double fpsCap = 0.0, bool lateInputSampling = false)
+        : frames(max(1u, maxFramesInFlight)), lateInputSampling(lateInputSampling)
+    {
+        SetFpsCap(fpsCap);
+        for (Frame &frame : frames)
+        {
+            glGenQueries(1, &frame.timestampQuery);
+            glGenQueries(1, &frame.startQuery);
+        }
+        nextDeadline = Clock::now();
+    }
+
+    void SetFpsCap(double fps) { period = fps > 0.0 ? chrono::duration<double>(1.0 / fps) : chrono::duration<double>(0.0); }
+    void SetLateInputSampling(bool enabled) { lateInputSampling = enabled; }
+    bool LateInputSampling() const { return lateInputSampling; }
+    unsigned int MaxFramesInFlight() const { return static_cast<unsigned int>(frames.size()); }
+
+    // blocks until a frame slot is free and, with a cap, until it's time for the next frame
+    void BeginFrame()
+    {
+        Frame &frame = frames[current];
+        auto start = Clock::now();
+        if (frame.fence)
+        {
+            GLenum result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            while (result == GL_TIMEOUT_EXPIRED)
+                result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+            if (result == GL_WAIT_FAILED)
+                cout << "ERROR::FRAME_PACER:: fence wait failed" << endl;
+            glDeleteSync(frame.fence);
+            frame.fence = nullptr;
+            collect(frame, milliseconds(Clock::now() - start));
+        }
+
+        if (period.count() > 0.0)
+        {
+            // a frame that ran late starts the cadence over instead of rushing the next few to catch up
+            auto now = Clock::now();
+            nextDeadline = max(nextDeadline + chrono::duration_cast<Clock::duration>(period), now);
+            auto wakeUp = nextDeadline;
+            if (lateInputSampling)
+                wakeUp -= chrono::duration_cast<Clock::duration>(expectedCpuTime + LATE_SAMPLING_MARGIN);
+            frame.sleepMilliseconds = sleepUntil(wakeUp);
+        }
+        else
+            frame.sleepMilliseconds = 0.0;
+
+        frame.cpuStart = Clock::now();
+        glGetInteger64v(GL_TIMESTAMP, &frame.inputGpuTime);
+        glQueryCounter(frame.startQuery, GL_TIMESTAMP);
+    }
+
+    // marks the end of the frame's GL commands, call right before swapping
+    void EndFrame()
+    {
+        Frame &frame = frames[current];
+        auto cpuTime = Clock::now() - frame.cpuStart;
+        frame.cpuMilliseconds = milliseconds(cpuTime);
+        // a slow moving average, one slow frame shouldn't make the next one sleep too little
+        expectedCpuTime = expectedCpuTime * 0.9 + chrono::duration<double>(cpuTime) * 0.1;
+
+        glGetInteger64v(GL_TIMESTAMP, &frame.submitGpuTime);
+        glQueryCounter(frame.timestampQuery, GL_TIMESTAMP);
+        frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = (current + 1) % frames.size();
+    }
+
+    const FramePacingStats &LastFrameStats() const { return stats; }
+
+private:
+    using Clock = chrono::steady_clock;
+
+    // how far ahead of the deadline late sampling wakes up on top of the expected CPU time
+    static constexpr chrono::duration<double> LATE_SAMPLING_MARGIN = chrono::duration<double>(0.001);
+    // sleeps shorter than this are spun instead, the OS scheduler isn't precise enough for them
+    static constexpr chrono::duration<double> SPIN_THRESHOLD = chrono::duration<double>(0.002);
+
+    struct Frame {
+        GLsync fence = nullptr;
+        GLuint timestampQuery = 0;
+        GLuint startQuery = 0;
+        GLint64 inputGpuTime = 0;
+        GLint64 submitGpuTime = 0;
+        Clock::time_point cpuStart;
+        double cpuMilliseconds = 0.0;
+        double sleepMilliseconds = 0.0;
+    };
+
+    vector<Frame> frames;
+    size_t current = 0;
+    bool lateInputSampling;
+    chrono::duration<double> period;
+    chrono::duration<double> expectedCpuTime = chrono::duration<double>(0.0);
+    Clock::time_point nextDeadline;
+    FramePacingStats stats;
+
+    static double milliseconds(Clock::duration duration)
+    {
+        return chrono::duration<double, milli>(duration).count();
+    }
+
+    static double sleepUntil(Clock::time_point wakeUp)
+    {
+        auto start = Clock::now();
+        if (wakeUp - start > SPIN_THRESHOLD)
+            this_thread::sleep_until(wakeUp - chrono::duration_cast<Clock::duration>(SPIN_THRESHOLD));
+        while (Clock::now() < wakeUp)
+            this_thread::yield();
+        return milliseconds(Clock::now() - start);
+    }
+
+    // the frame's fence has signalled, so its timestamp query is ready without stalling
+    void collect(Frame &frame, double fenceWaitMilliseconds)
+    {
+        GLint64 gpuStart = 0, gpuEnd = 0;
+        glGetQueryObjecti64v(frame.startQuery, GL_QUERY_RESULT, &gpuStart);
+        glGetQueryObjecti64v(frame.timestampQuery, GL_QUERY_RESULT, &gpuEnd);
+        stats.cpuMilliseconds = frame.cpuMilliseconds;
+        stats.gpuMilliseconds = (gpuEnd - gpuStart) / 1.0e6;
+        stats.sleepMilliseconds = frame.sleepMilliseconds;
+        stats.fenceWaitMilliseconds = fenceWaitMilliseconds;
+        stats.submitLatencyMilliseconds = (gpuEnd - frame.submitGpuTime) / 1.0e6;
+        stats.inputLatencyMilliseconds = (gpuEnd - frame.inputGpuTime) / 1.0e6;
+    }
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef FRAME_TIMINGS_H
+#define FRAME_TIMINGS_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Per-frame times of a run, in milliseconds, summarized once it's over.
+class FrameTimings {
+public:
+    void Add(double milliseconds) { samples.push_back(milliseconds); }
+    void Clear() { samples.clear(); }
+
+    size_t Count() const { return samples.size(); }
+    double Total() const
+    {
+        double total = 0.0;
+        for (double sample : samples)
+            total += sample;
+        return total;
+    }
+    double Mean() const { return samples.empty() ? 0.0 : Total() / samples.size(); }
+    double Min() const { return samples.empty() ? 0.0 : *min_element(samples.begin(), samples.end()); }
+    double Max() const { return samples.empty() ? 0.0 : *max_element(samples.begin(), samples.end()); }
+
+    // nearest-rank percentile, p between 0 and 100
+    double Percentile(double p) const
+    {
+        if (samples.empty())
+            return 0.0;
+        vector<double> sorted(samples);
+        size_t rank = static_cast<size_t>(ceil(p / 100.0 * sorted.size()));
+        size_t index = min(sorted.size() - 1, rank > 0 ? rank - 1 : 0);
+        nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+
+    // one line, e.g. "frame time: 600 frames, mean 4.1ms (243 fps), min 3.2ms p50 ...", the fps only make sense
+    // for whole frames
+    void Print(const char *label, bool withFps = true) const
+    {
+        double mean = Mean();
+        cout << label << ": " << Count() << " frames, mean " << mean << "ms";
+        if (withFps)
+            cout << " (" << (mean > 0.0 ? 1000.0 / mean : 0.0) << " fps)";
+        cout << ", min " << Min() << "ms p50 " << Percentile(50.0) << "ms p95 " << Percentile(95.0)
+             << "ms p99 " << Percentile(99.0) << "ms max " << Max() << "ms" << endl;
+    }
+
+    // counts of samples in bucketCount buckets bucketMilliseconds wide, the last one also holds everything longer
+    vector<unsigned int> Histogram(double bucketMilliseconds, unsigned int bucketCount) const
+    {
+        vector<unsigned int> counts(bucketCount, 0);
+        if (bucketCount == 0 || bucketMilliseconds <= 0.0)
+            return counts;
+        for (double sample : samples)
+            counts[min(static_cast<size_t>(sample / bucketMilliseconds), counts.size() - 1)]++;
+        return counts;
+    }
+
+    // a JSON object with the summary and the histogram, numbers in milliseconds
+    void WriteJson(ostream &out, double bucketMilliseconds, unsigned int bucketCount) const
+    {
+        out << "{\"count\": " << Count() << ", \"mean\": " << Mean() << ", \"min\": " << Min()
+            << ", \"p50\": " << Percentile(50.0) << ", \"p95\": " << Percentile(95.0) << ", \"p99\": " << Percentile(99.0)
+            << ", \"max\": " << Max() << ", \"histogram\": {\"bucketMilliseconds\": " << bucketMilliseconds << ", \"counts\": [";
+        vector<unsigned int> counts = Histogram(bucketMilliseconds, bucketCount);
+        for (size_t i = 0; i < counts.size(); i++)
+            out << (i > 0 ? ", " : "") << counts[i];
+        out << "]}}";
+    }
+
+    const vector<double> &Samples() const { return samples; }
+
+private:
+    vector<double> samples;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// the six clip planes of a view-projection matrix, normals point inwards and are normalized
+struct Frustum {
+    enum { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, PLANE_COUNT };
+    glm::vec4 planes[PLANE_COUNT];
+
+    // Gribb-Hartmann extraction: each plane is the last row of the matrix plus or minus one of the others
+    static Frustum FromMatrix(const glm::mat4 &viewProjection)
+    {
+        const glm::mat4 &m = viewProjection;
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+        Frustum frustum;
+        frustum.planes[LEFT]       = rows[3] + rows[0];
+        frustum.planes[RIGHT]      = rows[3] - rows[0];
+        frustum.planes[BOTTOM]     = rows[3] + rows[1];
+        frustum.planes[TOP]        = rows[3] - rows[1];
+        frustum.planes[NEAR_PLANE] = rows[3] + rows[2];
+        frustum.planes[FAR_PLANE]  = rows[3] - rows[2];
+        for (glm::vec4 &plane : frustum.planes)
+            plane = plane / glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // plane-vs-box test on a single box, false when the box is entirely outside one plane
+    bool Intersects(const AABB &box) const
+    {
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        for (const glm::vec4 &plane : planes)
+        {
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+// counters for one frame of culling
+struct CullStats {
+    unsigned int tested = 0;
+    unsigned int visible = 0;
+    double microseconds = 0.0;
+
+    unsigned int Culled() const { return tested - visible; }
+};
+
+// Culls boxes against a frustum in batches. Boxes are stored as structure-of-arrays (center and extents per axis)
+// so the kernel can test 8 boxes per instruction with AVX or 4 with SSE, with a scalar fallback elsewhere.
+// Usage per batch: Add() every box, then Cull() which returns the indices of the visible ones (in Add order)
+// and empties the batch. Stats add up until EndFrame().
+class FrustumCuller {
+public:
+    void Add(const AABB &box)
+    {
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        centerX.push_back(center.x);
+        centerY.push_back(center.y);
+        centerZ.push_back(center.z);
+        extentX.push_back(extents.x);
+        extentY.push_back(extents.y);
+        extentZ.push_back(extents.z);
+    }
+
+    // number of boxes waiting to be culled
+    size_t Size() const { return centerX.size(); }
+
+    // tests every added box, fills visible with the indices of those intersecting the frustum
+    void Cull(const Frustum &frustum, vector<unsigned int> &visible)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        size_t count = Size();
+        visible.clear();
+
+        // pad to a whole SIMD batch, the padding lanes are masked off below
+        size_t padded = (count + WIDTH - 1) / WIDTH * WIDTH;
+        for (vector<float> *column : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+            column->resize(padded, 0.0f);
+
+        for (size_t i = 0; i < padded; i += WIDTH)
+        {
+            uint32_t mask = testBatch(frustum, i);
+            if (count - i < WIDTH)
+                mask &= (1u << (count - i)) - 1u;
+            while (mask)
+            {
+                unsigned int lane = countTrailingZeros(mask);
+                visible.push_back(static_cast<unsigned int>(i + lane));
+                mask &= mask - 1u;
+            }
+        }
+
+        for (vector<float> *column : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+            column->clear();
+
+        frameStats.tested += static_cast<unsigned int>(count);
+        frameStats.visible += static_cast<unsigned int>(visible.size());
+        frameStats.microseconds += chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // closes the frame's stats, LastFrameStats reports them until the next EndFrame
+    void EndFrame()
+    {
+        lastFrameStats = frameStats;
+        frameStats = CullStats();
+    }
+
+    const CullStats &LastFrameStats() const { return lastFrameStats; }
+
+private:
+#if defined(__AVX__)
+    static const size_t WIDTH = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+    static const size_t WIDTH = 4;
+#else
+    static const size_t WIDTH = 1;
+#endif
+
+    vector<float> centerX, centerY, centerZ;
+    vector<float> extentX, extentY, extentZ;
+    CullStats frameStats, lastFrameStats;
+
+    static unsigned int countTrailingZeros(uint32_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned int>(__builtin_ctz(value));
+#else
+        unsigned int n = 0;
+        while (!(value & 1u)) { value >>= 1; n++; }
+        return n;
+#endif
+    }
+
+    // returns a bit per lane, set when the box at first + lane is at least partly inside every plane.
+    // For each plane the box is outside when center distance + projected extents < 0.
+    uint32_t testBatch(const Frustum &frustum, size_t first) const
+    {
+#if defined(__AVX__)
+        __m256 cx = _mm256_loadu_ps(&centerX[first]), cy = _mm256_loadu_ps(&centerY[first]), cz = _mm256_loadu_ps(&centerZ[first]);
+        __m256 ex = _mm256_loadu_ps(&extentX[first]), ey = _mm256_loadu_ps(&extentY[first]), ez = _mm256_loadu_ps(&extentZ[first]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4 &plane : frustum.planes)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx),
+                                                          _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+                                            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), ex),
+                                                        _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), ey)),
+                                          _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        return static_cast<uint32_t>(_mm256_movemask_ps(inside));
+#elif defined(__SSE2__) || defined(_M_X64)
+        __m128 cx = _mm_loadu_ps(&centerX[first]), cy = _mm_loadu_ps(&centerY[first]), cz = _mm_loadu_ps(&centerZ[first]);
+        __m128 ex = _mm_loadu_ps(&extentX[first]), ey = _mm_loadu_ps(&extentY[first]), ez = _mm_loadu_ps(&extentZ[first]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4 &plane : frustum.planes)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), ex),
+                                                  _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ey)),
+                                       _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        return static_cast<uint32_t>(_mm_movemask_ps(inside));
+#else
+        AABB box;
+        glm::vec3 center(centerX[first], centerY[first], centerZ[first]);
+        glm::vec3 extents(extentX[first], extentY[first], extentZ[first]);
+        box.min = center - extents;
+        box.max = center + extents;
+        return frustum.Intersects(box) ? 1u : 0u;
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef GL_CAPTURE_H
+#define GL_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A capture file is a header and then one record after another, all little-endian as written:
+//   header   "LOGLCAP\0", u32 version, u32 width, u32 height of the frame, u32 entry count, the entry point names
+//            each as a u16 length and the characters. Records name their entry point by its index in this list.
+//   call     u16 entry, the arguments in order, the return value as a u64 unless void, then the names a glGen*
+//            call generated
+//   frame    u16 GL_CAPTURE_FRAME, the end of a frame. Calls before the first one are the loading.
+//   memory   u16 GL_CAPTURE_MEMORY, u64 mapping, u64 offset, u64 size and the bytes the renderer wrote through a
+//            mapped buffer since they were last recorded
+// An argument is its value as passed, a pointer as a u64. Pointers to data the call reads are followed by the data,
+// see GLArg. Object names, sync objects and uniform locations are recorded as the renderer saw them, a replay maps
+// them onto its own.
+#define GL_CAPTURE_VERSION 1
+#define GL_CAPTURE_FRAME 0xFFFF
+#define GL_CAPTURE_MEMORY 0xFFFE
+
+// how an argument is recorded
+enum class GLArg {
+    Value,   // as passed
+    Offset,  // a pointer used as a value, e.g. an offset into the bound buffer, only the u64
+    Data,    // a pointer to data the call reads, followed by a u64 size and the bytes when not null
+    String,  // a null terminated string, followed by a u64 size and the characters
+    Strings, // an array of strings, followed by a u64 count and each string as a u64 size and the characters
+    Output,  // a pointer the call writes to, only the u64
+    Unused   // only the u64, a replay passes null
+};
+
+// the kind of object a value names, if any
+enum class GLName { None, Buffer, Texture, VertexArray, Framebuffer, Renderbuffer, Query, Program, Shader, Sync, Location, Mapping };
+
+struct GLArgSpec {
+    GLArg kind = GLArg::Value;
+    GLName name = GLName::None; // for Data, every element of the array
+};
+
+// Writes a capture file, see the layout above. Also keeps a copy of every mapped buffer range so what the renderer
+// writes through the pointer can be recorded as memory records, the driver never sees those writes. The renderer
+// marks what it wrote, and only the marked bytes are compared against the copy.
+class GLCaptureWriter {
+public:
+    bool Open(const string &path, unsigned int width, unsigned int height, const vector<const char*> &entries)
+    {
+        file.open(path, ios::binary);
+        if (!file)
+            return false;
+        file.write("LOGLCAP", 8);
+        Write<uint32_t>(GL_CAPTURE_VERSION);
+        Write<uint32_t>(width);
+        Write<uint32_t>(height);
+        Write<uint32_t>(static_cast<uint32_t>(entries.size()));
+        for (const char *entry : entries)
+        {
+            uint16_t length = static_cast<uint16_t>(strlen(entry));
+            Write(length);
+            file.write(entry, length);
+        }
+        return static_cast<bool>(file);
+    }
+
+    bool IsOpen() const { return file.is_open(); }
+
+    void Close()
+    {
+        file.close();
+        mappings.clear();
+    }
+
+    template <typename T>
+    void Write(const T &value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        bytes += sizeof(T);
+    }
+
+    // a u64 size and the bytes
+    void WriteBytes(const void *data, uint64_t size)
+    {
+        Write(size);
+        file.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+        bytes += size;
+    }
+
+    void EndFrame()
+    {
+        Write<uint16_t>(GL_CAPTURE_FRAME);
+        frames++;
+    }
+
+    // a range mapped from buffer, id is what glMapBufferRange returned
+    void AddMapping(uint64_t id, GLuint buffer, const void *pointer, size_t size)
+    {
+        const char *data = static_cast<const char*>(pointer);
+        mappings.push_back(Mapping{id, buffer, data, vector<char>(data, data + size), 0, 0});
+    }
+
+    // size bytes at data were written, if they're in a mapped range the next FlushMappings looks at them
+    void MarkWritten(const void *data, size_t size)
+    {
+        const char *written = static_cast<const char*>(data);
+        for (Mapping &mapping : mappings)
+        {
+            if (written < mapping.pointer || written >= mapping.pointer + mapping.copy.size())
+                continue;
+            size_t first = static_cast<size_t>(written - mapping.pointer);
+            size_t last = min(first + size, mapping.copy.size());
+            if (mapping.dirtyFirst == mapping.dirtyLast)
+            {
+                mapping.dirtyFirst = first;
+                mapping.dirtyLast = last;
+            }
+            else
+            {
+                mapping.dirtyFirst = min(mapping.dirtyFirst, first);
+                mapping.dirtyLast = max(mapping.dirtyLast, last);
+            }
+        }
+    }
+
+    // the buffer is going away, its mappings with it
+    void RemoveMappings(GLuint buffer)
+    {
+        FlushMappings();
+        mappings.erase(remove_if(mappings.begin(), mappings.end(), [buffer](const Mapping &mapping) { return mapping.buffer == buffer; }),
+                       mappings.end());
+    }
+
+    // records whatever changed in the bytes marked since the last flush, one span per range from the first to the
+    // last byte that differs. Called before anything that could read them.
+    void FlushMappings()
+    {
+        for (Mapping &mapping : mappings)
+        {
+            size_t first = mapping.dirtyFirst, last = mapping.dirtyLast;
+            mapping.dirtyFirst = mapping.dirtyLast = 0;
+            while (first < last && mapping.pointer[first] == mapping.copy[first])
+                first++;
+            while (last > first && mapping.pointer[last - 1] == mapping.copy[last - 1])
+                last--;
+            if (first == last)
+                continue;
+            memcpy(mapping.copy.data() + first, mapping.pointer + first, last - first);
+            Write<uint16_t>(GL_CAPTURE_MEMORY);
+            Write(mapping.id);
+            Write<uint64_t>(first);
+            WriteBytes(mapping.copy.data() + first, last - first);
+        }
+    }
+
+    unsigned int Frames() const { return frames; }
+    uint64_t BytesWritten() const { return bytes; }
+
+private:
+    struct Mapping {
+        uint64_t id;
+        GLuint buffer;
+        const char *pointer;
+        vector<char> copy; // the contents as last recorded
+        size_t dirtyFirst, dirtyLast; // the bytes marked since the last flush, empty when equal
+    };
+
+    ofstream file;
+    vector<Mapping> mappings;
+    unsigned int frames = 0;
+    uint64_t bytes = 0;
+};
+
+// Reads a capture file back, the header on Open and then a value at a time
+class GLCaptureReader {
+public:
+    unsigned int width = 0, height = 0;
+    vector<string> entries;
+
+    bool Open(const string &path)
+    {
+        file.open(path, ios::binary);
+        char magic[8] = {};
+        file.read(magic, 8);
+        if (!file || memcmp(magic, "LOGLCAP", 8) != 0)
+        {
+            error = "not a capture file";
+            return false;
+        }
+        uint32_t version = Read<uint32_t>();
+        if (version != GL_CAPTURE_VERSION)
+        {
+            error = "capture version " + to_string(version) + ", expected " + to_string(GL_CAPTURE_VERSION);
+            return false;
+        }
+        width = Read<uint32_t>();
+        height = Read<uint32_t>();
+        uint32_t count = Read<uint32_t>();
+        for (uint32_t i = 0; i < count && file; i++)
+        {
+            string name(Read<uint16_t>(), '\0');
+            file.read(&name[0], static_cast<streamsize>(name.size()));
+            entries.push_back(name);
+        }
+        if (!file)
+            error = "truncated header";
+        return static_cast<bool>(file);
+    }
+
+    const string &Error() const { return error; }
+
+    // false at the end of the file
+    bool Next(uint16_t &record)
+    {
+        file.read(reinterpret_cast<char*>(&record), sizeof(record));
+        return static_cast<bool>(file);
+    }
+
+    template <typename T>
+    T Read()
+    {
+        T value{};
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    // a u64 size and the bytes, with a null after them for strings
+    vector<char> ReadBytes()
+    {
+        uint64_t size = Read<uint64_t>();
+        vector<char> data(static_cast<size_t>(size) + 1, '\0');
+        file.read(data.data(), static_cast<streamsize>(size));
+        return data;
+    }
+
+    // false once a read ran past the end, a record cut short
+    bool Good() const { return static_cast<bool>(file); }
+
+private:
+    ifstream file;
+    string error;
+};
+
+#endif
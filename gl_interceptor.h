@@ -0,0 +1,753 @@
+#ifndef GL_INTERCEPTOR_H
+#define GL_INTERCEPTOR_H
+
+#include <glad/glad.h>
+
+#include "gl_capture.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// every GL entry point the renderer calls, the ones the interceptor wraps. Calls to anything else go straight to
+// the driver uncounted, add them here when the renderer starts using them.
+#define GL_INTERCEPTED_FUNCTIONS(X) \
+    X(glActiveTexture) X(glAttachShader) X(glBindBuffer) X(glBindBufferBase) X(glBindBufferRange)                 \
+    X(glBindFramebuffer) X(glBindImageTexture) X(glBindRenderbuffer) X(glBindTexture) X(glBindVertexArray)        \
+    X(glBufferData) X(glBufferStorage) X(glBufferSubData) X(glCheckFramebufferStatus) X(glClear)                  \
+    X(glClearBufferData) X(glClearColor) X(glClientWaitSync) X(glCompileShader) X(glCopyTexSubImage2D)            \
+    X(glCreateProgram) X(glCreateShader) X(glDeleteBuffers) X(glDeleteFramebuffers) X(glDeleteProgram)           \
+    X(glDeleteQueries) X(glDeleteRenderbuffers) X(glDeleteShader) X(glDeleteSync) X(glDeleteTextures)             \
+    X(glDeleteVertexArrays) X(glDisable) X(glDispatchCompute) X(glDrawElements)                                   \
+    X(glDrawElementsInstancedBaseInstance) X(glEnable) X(glEnableVertexAttribArray) X(glFenceSync) X(glFinish)    \
+    X(glFlush) X(glFramebufferRenderbuffer) X(glGenBuffers) X(glGenFramebuffers) X(glGenQueries)                  \
+    X(glGenRenderbuffers) X(glGenTextures) X(glGenVertexArrays) X(glGenerateMipmap) X(glGetInteger64v)            \
+    X(glGetIntegerv) X(glGetProgramInfoLog) X(glGetProgramiv) X(glGetQueryObjecti64v) X(glGetQueryObjectiv)       \
+    X(glGetQueryObjectui64v) X(glGetShaderInfoLog) X(glGetShaderiv) X(glGetUniformBlockIndex)                     \
+    X(glGetUniformLocation) X(glLinkProgram) X(glMapBufferRange) X(glMemoryBarrier)                               \
+    X(glMultiDrawElementsIndirect) X(glMultiDrawElementsIndirectCount) X(glPixelStorei) X(glPolygonMode)          \
+    X(glQueryCounter) X(glRenderbufferStorage) X(glShaderSource) X(glTexImage2D) X(glTexImage3D)                  \
+    X(glTexParameteri) X(glTexStorage2D) X(glTexSubImage2D) X(glTexSubImage3D) X(glUniform1f) X(glUniform1i)     \
+    X(glUniform1ui) X(glUniform2f) X(glUniform2fv) X(glUniform2i) X(glUniform3f) X(glUniform3fv) X(glUniform4f)  \
+    X(glUniform4fv) X(glUniformMatrix2fv) X(glUniformMatrix3fv) X(glUniformMatrix4fv) X(glUseProgram)            \
+    X(glVertexAttribDivisor) X(glVertexAttribIPointer) X(glVertexAttribPointer) X(glViewport)
+
+enum GLEntry {
+#define GL_INTERCEPTOR_ENTRY(name) GL_ENTRY_##name,
+    GL_INTERCEPTED_FUNCTIONS(GL_INTERCEPTOR_ENTRY)
+#undef GL_INTERCEPTOR_ENTRY
+    GL_ENTRY_COUNT
+};
+
+struct GLCallStats {
+    unsigned int calls = 0;
+    uint64_t nanoseconds = 0; // inside the driver
+    unsigned int redundant = 0; // set state to what it already was
+};
+
+// one frame's GL calls
+struct GLFrameStats {
+    GLCallStats entries[GL_ENTRY_COUNT];
+    unsigned int calls = 0;
+    unsigned int redundant = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t bytesUploaded = 0; // through glBufferData, glBufferSubData, glBufferStorage and glTex(Sub)Image
+
+    double DriverMilliseconds() const { return nanoseconds / 1.0e6; }
+};
+
+// Counts and times every GL call the renderer makes, by swapping glad's function pointers for wrappers.
+//
+// glad calls GL through a global pointer per entry point, glad_glClear behind glClear and so on. SetEnabled(true)
+// saves the driver's pointers and puts a wrapper in each, SetEnabled(false) puts them back, so switched off the
+// renderer calls the driver exactly as if the interceptor didn't exist. A wrapper counts the call, times it and
+// checks it against the state it shadows: the bound program, vertex array, buffers per target and indexed
+// binding, textures per unit, enabled caps, framebuffers, clear color, viewport and uniform values per program.
+// Setting state to what it already is counts as redundant. The shadow starts empty whenever the interceptor is
+// switched on, and deleting any object or relinking a program forgets it all, so a redundant call is one for sure
+// and some go unnoticed. Uploads through a mapped buffer can't be seen and aren't counted. While the profiler is
+// recording, a call that spends SLOW_CALL_NANOSECONDS or more in the driver is also recorded as a zone named after
+// its entry point, so a shader link or a texture upload shows up in the trace of the frame it stalled.
+//
+// The wrappers can also write every call to a capture file, see gl_capture.h, for learnOpenGL_replay to run again
+// on a headless context. A capture has to start before the renderer creates anything, the replay builds every
+// object it uses from the calls that made it.
+//
+// Usage: after gladLoadGLLoader, SetEnabled(true) or StartCapture, then EndFrame() once per frame. Main thread only,
+// like GL.
+class GLInterceptor {
+public:
+    static constexpr uint64_t SLOW_CALL_NANOSECONDS = 100000;
+
+    static bool IsEnabled() { return enabled; }
+
+    static void SetEnabled(bool on)
+    {
+        if (on == enabled)
+            return;
+        if (!on && capture.IsOpen())
+        {
+            cout << "ERROR::GL_INTERCEPTOR:: switched off mid-capture, the capture ends here" << endl;
+            finishCapture();
+        }
+        enabled = on;
+        forgetState();
+        current = GLFrameStats();
+#define GL_INTERCEPTOR_HOOK(name) hook<&glad_##name, GL_ENTRY_##name>(on);
+        GL_INTERCEPTED_FUNCTIONS(GL_INTERCEPTOR_HOOK)
+#undef GL_INTERCEPTOR_HOOK
+    }
+
+    static void EndFrame()
+    {
+        if (!enabled)
+            return;
+        last = current;
+        current = GLFrameStats();
+        if (capture.IsOpen())
+        {
+            capture.EndFrame();
+            // the first frame a capture ends is the loading
+            if (capture.Frames() > captureFrames)
+                StopCapture();
+        }
+    }
+
+    // records every call from here on into path, the loading up to the first EndFrame and then frames frames.
+    // width and height are the size of the frame, the replay renders into a framebuffer that size where the
+    // renderer used the window's.
+    static bool StartCapture(const string &path, unsigned int frames, unsigned int width, unsigned int height)
+    {
+        if (capture.IsOpen())
+            return false;
+        vector<const char*> names;
+        for (unsigned int i = 0; i < GL_ENTRY_COUNT; i++)
+            names.push_back(EntryName(i));
+        if (!capture.Open(path, width, height, names))
+        {
+            cout << "ERROR::GL_INTERCEPTOR:: can't write " << path << endl;
+            return false;
+        }
+        capturePath = path;
+        captureFrames = frames;
+        captureBuffers.clear();
+        enabledBeforeCapture = enabled;
+        SetEnabled(true);
+        return true;
+    }
+
+    static bool IsCapturing() { return capture.IsOpen(); }
+
+    // the renderer wrote size bytes through a mapped pointer. A capture only records what was marked, so mark
+    // the bytes before the call that reads them.
+    static void MarkWritten(const void *data, size_t size)
+    {
+        if (capture.IsOpen())
+            capture.MarkWritten(data, size);
+    }
+
+    // ends the capture early, or does nothing if there's none
+    static void StopCapture()
+    {
+        if (!capture.IsOpen())
+            return;
+        finishCapture();
+        if (!enabledBeforeCapture)
+            SetEnabled(false);
+    }
+
+    static const GLFrameStats &LastFrameStats() { return last; }
+
+    static const char *EntryName(unsigned int entry)
+    {
+        static const char *const names[] = {
+#define GL_INTERCEPTOR_NAME(name) #name,
+            GL_INTERCEPTED_FUNCTIONS(GL_INTERCEPTOR_NAME)
+#undef GL_INTERCEPTOR_NAME
+        };
+        return entry < GL_ENTRY_COUNT ? names[entry] : "?";
+    }
+
+    // the frame's totals and the entry points that took the most driver time
+    static void Print(unsigned int top = 8)
+    {
+        vector<unsigned int> order;
+        for (unsigned int i = 0; i < GL_ENTRY_COUNT; i++)
+            if (last.entries[i].calls > 0)
+                order.push_back(i);
+        sort(order.begin(), order.end(), [](unsigned int a, unsigned int b) {
+            return last.entries[a].nanoseconds > last.entries[b].nanoseconds;
+        });
+        cout << "gl calls: " << last.calls << " in " << last.DriverMilliseconds() << "ms, " << last.redundant
+             << " redundant, " << last.bytesUploaded << " bytes uploaded;";
+        for (size_t i = 0; i < order.size() && i < top; i++)
+        {
+            const GLCallStats &entry = last.entries[order[i]];
+            cout << " " << EntryName(order[i]) << " " << entry.calls << "x " << entry.nanoseconds / 1000.0 << "us";
+            if (entry.redundant > 0)
+                cout << " (" << entry.redundant << " redundant)";
+        }
+        cout << endl;
+    }
+
+    // how a capture records each argument, the replay reads them back the same way
+    static constexpr GLArgSpec ArgSpec(unsigned int entry, unsigned int index)
+    {
+        switch (entry)
+        {
+        case GL_ENTRY_glAttachShader:
+            return GLArgSpec{GLArg::Value, index == 0 ? GLName::Program : GLName::Shader};
+        case GL_ENTRY_glBindBuffer:
+            return GLArgSpec{GLArg::Value, index == 1 ? GLName::Buffer : GLName::None};
+        case GL_ENTRY_glBindBufferBase:
+        case GL_ENTRY_glBindBufferRange:
+            return GLArgSpec{GLArg::Value, index == 2 ? GLName::Buffer : GLName::None};
+        case GL_ENTRY_glBindFramebuffer:
+            return GLArgSpec{GLArg::Value, index == 1 ? GLName::Framebuffer : GLName::None};
+        case GL_ENTRY_glBindImageTexture:
+        case GL_ENTRY_glBindTexture:
+            return GLArgSpec{GLArg::Value, index == 1 ? GLName::Texture : GLName::None};
+        case GL_ENTRY_glBindRenderbuffer:
+            return GLArgSpec{GLArg::Value, index == 1 ? GLName::Renderbuffer : GLName::None};
+        case GL_ENTRY_glFramebufferRenderbuffer:
+            return GLArgSpec{GLArg::Value, index == 3 ? GLName::Renderbuffer : GLName::None};
+        case GL_ENTRY_glBindVertexArray:
+            return GLArgSpec{GLArg::Value, GLName::VertexArray};
+        case GL_ENTRY_glCompileShader:
+        case GL_ENTRY_glDeleteShader:
+            return GLArgSpec{GLArg::Value, GLName::Shader};
+        case GL_ENTRY_glDeleteProgram:
+        case GL_ENTRY_glLinkProgram:
+        case GL_ENTRY_glUseProgram:
+            return GLArgSpec{GLArg::Value, GLName::Program};
+        case GL_ENTRY_glQueryCounter:
+            return GLArgSpec{GLArg::Value, index == 0 ? GLName::Query : GLName::None};
+        case GL_ENTRY_glClientWaitSync:
+        case GL_ENTRY_glDeleteSync:
+            return index == 0 ? GLArgSpec{GLArg::Offset, GLName::Sync} : GLArgSpec{};
+        case GL_ENTRY_glDeleteBuffers:
+            return index == 1 ? GLArgSpec{GLArg::Data, GLName::Buffer} : GLArgSpec{};
+        case GL_ENTRY_glDeleteFramebuffers:
+            return index == 1 ? GLArgSpec{GLArg::Data, GLName::Framebuffer} : GLArgSpec{};
+        case GL_ENTRY_glDeleteQueries:
+            return index == 1 ? GLArgSpec{GLArg::Data, GLName::Query} : GLArgSpec{};
+        case GL_ENTRY_glDeleteRenderbuffers:
+            return index == 1 ? GLArgSpec{GLArg::Data, GLName::Renderbuffer} : GLArgSpec{};
+        case GL_ENTRY_glDeleteTextures:
+            return index == 1 ? GLArgSpec{GLArg::Data, GLName::Texture} : GLArgSpec{};
+        case GL_ENTRY_glDeleteVertexArrays:
+            return index == 1 ? GLArgSpec{GLArg::Data, GLName::VertexArray} : GLArgSpec{};
+        case GL_ENTRY_glGenBuffers:
+        case GL_ENTRY_glGenFramebuffers:
+        case GL_ENTRY_glGenQueries:
+        case GL_ENTRY_glGenRenderbuffers:
+        case GL_ENTRY_glGenTextures:
+        case GL_ENTRY_glGenVertexArrays:
+        case GL_ENTRY_glGetInteger64v:
+        case GL_ENTRY_glGetIntegerv:
+            return GLArgSpec{index == 1 ? GLArg::Output : GLArg::Value};
+        case GL_ENTRY_glGetProgramiv:
+        case GL_ENTRY_glGetProgramInfoLog:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Program} : GLArgSpec{index >= 2 ? GLArg::Output : GLArg::Value};
+        case GL_ENTRY_glGetShaderiv:
+        case GL_ENTRY_glGetShaderInfoLog:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Shader} : GLArgSpec{index >= 2 ? GLArg::Output : GLArg::Value};
+        case GL_ENTRY_glGetQueryObjecti64v:
+        case GL_ENTRY_glGetQueryObjectiv:
+        case GL_ENTRY_glGetQueryObjectui64v:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Query} : GLArgSpec{index == 2 ? GLArg::Output : GLArg::Value};
+        case GL_ENTRY_glGetUniformBlockIndex:
+        case GL_ENTRY_glGetUniformLocation:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Program} : GLArgSpec{GLArg::String};
+        case GL_ENTRY_glShaderSource:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Shader}
+                 : GLArgSpec{index == 2 ? GLArg::Strings : index == 3 ? GLArg::Unused : GLArg::Value};
+        case GL_ENTRY_glBufferData:
+        case GL_ENTRY_glBufferStorage:
+            return GLArgSpec{index == 2 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glBufferSubData:
+            return GLArgSpec{index == 3 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glClearBufferData:
+            return GLArgSpec{index == 4 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glTexImage2D:
+        case GL_ENTRY_glTexSubImage2D:
+            return GLArgSpec{index == 8 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glTexImage3D:
+            return GLArgSpec{index == 9 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glTexSubImage3D:
+            return GLArgSpec{index == 10 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glDrawElements:
+        case GL_ENTRY_glDrawElementsInstancedBaseInstance:
+            return GLArgSpec{index == 3 ? GLArg::Offset : GLArg::Value};
+        case GL_ENTRY_glMultiDrawElementsIndirect:
+        case GL_ENTRY_glMultiDrawElementsIndirectCount:
+            return GLArgSpec{index == 2 ? GLArg::Offset : GLArg::Value};
+        case GL_ENTRY_glVertexAttribPointer:
+            return GLArgSpec{index == 5 ? GLArg::Offset : GLArg::Value};
+        case GL_ENTRY_glVertexAttribIPointer:
+            return GLArgSpec{index == 4 ? GLArg::Offset : GLArg::Value};
+        case GL_ENTRY_glUniform1f: case GL_ENTRY_glUniform1i: case GL_ENTRY_glUniform1ui: case GL_ENTRY_glUniform2f:
+        case GL_ENTRY_glUniform2i: case GL_ENTRY_glUniform3f: case GL_ENTRY_glUniform4f:
+            return GLArgSpec{GLArg::Value, index == 0 ? GLName::Location : GLName::None};
+        case GL_ENTRY_glUniform2fv: case GL_ENTRY_glUniform3fv: case GL_ENTRY_glUniform4fv:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Location} : GLArgSpec{index == 2 ? GLArg::Data : GLArg::Value};
+        case GL_ENTRY_glUniformMatrix2fv: case GL_ENTRY_glUniformMatrix3fv: case GL_ENTRY_glUniformMatrix4fv:
+            return index == 0 ? GLArgSpec{GLArg::Value, GLName::Location} : GLArgSpec{index == 3 ? GLArg::Data : GLArg::Value};
+        default:
+            return GLArgSpec{};
+        }
+    }
+
+    // what a return value names, the replay maps the one it gets onto the captured one
+    static constexpr GLName ReturnName(unsigned int entry)
+    {
+        switch (entry)
+        {
+        case GL_ENTRY_glCreateProgram: return GLName::Program;
+        case GL_ENTRY_glCreateShader: return GLName::Shader;
+        case GL_ENTRY_glFenceSync: return GLName::Sync;
+        case GL_ENTRY_glGetUniformLocation: return GLName::Location;
+        case GL_ENTRY_glMapBufferRange: return GLName::Mapping;
+        default: return GLName::None;
+        }
+    }
+
+    // what the names a glGen* call writes to its second argument are, recorded after the call
+    static constexpr GLName GeneratedName(unsigned int entry)
+    {
+        switch (entry)
+        {
+        case GL_ENTRY_glGenBuffers: return GLName::Buffer;
+        case GL_ENTRY_glGenFramebuffers: return GLName::Framebuffer;
+        case GL_ENTRY_glGenQueries: return GLName::Query;
+        case GL_ENTRY_glGenRenderbuffers: return GLName::Renderbuffer;
+        case GL_ENTRY_glGenTextures: return GLName::Texture;
+        case GL_ENTRY_glGenVertexArrays: return GLName::VertexArray;
+        default: return GLName::None;
+        }
+    }
+
+private:
+    using Clock = chrono::steady_clock;
+
+    static inline bool enabled = false;
+    static inline GLFrameStats current, last;
+
+    // the state calls are checked against
+    static inline GLuint program = 0;
+    static inline bool programKnown = false;
+    static inline GLuint vertexArray = 0;
+    static inline bool vertexArrayKnown = false;
+    static inline GLenum activeTexture = GL_TEXTURE0;
+    static inline map<GLenum, GLuint> buffers;                            // target -> buffer
+    static inline map<pair<GLenum, GLuint>, tuple<GLuint, GLintptr, GLsizeiptr>> indexedBuffers; // (target, index)
+    static inline map<pair<GLenum, GLenum>, GLuint> textures;            // (unit, target) -> texture
+    static inline map<GLenum, bool> caps;
+    static inline map<GLenum, GLuint> framebuffers;
+    static inline map<GLenum, GLuint> renderbuffers;
+    static inline vector<GLfloat> clearColor;
+    static inline vector<GLint> viewport;
+    static inline map<pair<GLuint, GLint>, vector<unsigned char>> uniforms; // (program, location) -> value bytes
+    static inline GLint unpackAlignment = 4;
+
+    static inline GLCaptureWriter capture;
+    static inline string capturePath;
+    static inline unsigned int captureFrames = 0;
+    static inline bool enabledBeforeCapture = false;
+    static inline map<GLenum, GLuint> captureBuffers; // target -> buffer, for the buffer behind a mapping
+
+    template <auto Slot, unsigned int Entry, typename Pointer = remove_pointer_t<decltype(Slot)>>
+    struct Hook;
+
+    template <auto Slot, unsigned int Entry, typename R, typename... Args>
+    struct Hook<Slot, Entry, R (APIENTRY *)(Args...)> {
+        static inline R (APIENTRY *driver)(Args...) = nullptr;
+
+        static R APIENTRY Call(Args... args)
+        {
+            inspect<Entry>(args...);
+            if (capture.IsOpen())
+                captureCall<Entry>(args...);
+            auto start = Clock::now();
+            if constexpr (is_void_v<R>)
+            {
+                driver(args...);
+                count(Entry, start);
+                if (capture.IsOpen())
+                    captureGenerated<Entry>(args...);
+            }
+            else
+            {
+                R result = driver(args...);
+                count(Entry, start);
+                if (capture.IsOpen())
+                    captureResult<Entry>(result, args...);
+                return result;
+            }
+        }
+    };
+
+    template <auto Slot, unsigned int Entry>
+    static void hook(bool install)
+    {
+        using H = Hook<Slot, Entry>;
+        if (install)
+        {
+            // entry points the context doesn't have stay null
+            H::driver = *Slot;
+            if (*Slot)
+                *Slot = &H::Call;
+        }
+        else if (H::driver)
+            *Slot = H::driver;
+    }
+
+    static void count(unsigned int entry, Clock::time_point start)
+    {
+        uint64_t nanoseconds = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        GLCallStats &stats = current.entries[entry];
+        stats.calls++;
+        stats.nanoseconds += nanoseconds;
+        current.calls++;
+        current.nanoseconds += nanoseconds;
+        if (nanoseconds >= SLOW_CALL_NANOSECONDS && Profiler::IsEnabled())
+        {
+            static const ProfileZone zones[] = {
+#define GL_INTERCEPTOR_ZONE(name) {#name, __FILE__, __LINE__},
+                GL_INTERCEPTED_FUNCTIONS(GL_INTERCEPTOR_ZONE)
+#undef GL_INTERCEPTOR_ZONE
+            };
+            uint64_t end = Profiler::Now();
+            Profiler::Record(&zones[entry], end - min(end, nanoseconds), end);
+        }
+    }
+
+    static void redundantCall(unsigned int entry)
+    {
+        current.entries[entry].redundant++;
+        current.redundant++;
+    }
+
+    static void forgetState()
+    {
+        programKnown = vertexArrayKnown = false;
+        activeTexture = GL_TEXTURE0;
+        buffers.clear();
+        indexedBuffers.clear();
+        textures.clear();
+        caps.clear();
+        framebuffers.clear();
+        renderbuffers.clear();
+        clearColor.clear();
+        viewport.clear();
+        uniforms.clear();
+    }
+
+    // records value under key, true when the key already held it
+    template <typename Map, typename Key, typename Value>
+    static bool update(Map &state, const Key &key, const Value &value)
+    {
+        auto found = state.find(key);
+        if (found != state.end() && found->second == value)
+            return true;
+        state[key] = value;
+        return false;
+    }
+
+    template <typename T>
+    static bool updateValues(vector<T> &state, initializer_list<T> values)
+    {
+        if (equal(state.begin(), state.end(), values.begin(), values.end()))
+            return true;
+        state.assign(values);
+        return false;
+    }
+
+    // the uniform's new value as bytes against the one last set for the bound program
+    static bool updateUniform(GLint location, const void *data, size_t size)
+    {
+        if (!programKnown || location < 0)
+            return false;
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        return update(uniforms, make_pair(program, location), vector<unsigned char>(bytes, bytes + size));
+    }
+
+    template <typename... Values>
+    static bool updateUniformValues(GLint location, Values... values)
+    {
+        unsigned char bytes[(sizeof(Values) + ... + 0)];
+        size_t offset = 0;
+        ((memcpy(bytes + offset, &values, sizeof(Values)), offset += sizeof(Values)), ...);
+        return updateUniform(location, bytes, sizeof(bytes));
+    }
+
+    // bytes the data argument of a call ArgSpec marks as Data points at
+    template <unsigned int Entry, typename Tuple>
+    static uint64_t dataSize(const Tuple &args)
+    {
+        if constexpr (Entry == GL_ENTRY_glBufferData || Entry == GL_ENTRY_glBufferStorage)
+            return static_cast<uint64_t>(get<1>(args));
+        else if constexpr (Entry == GL_ENTRY_glBufferSubData)
+            return static_cast<uint64_t>(get<2>(args));
+        else if constexpr (Entry == GL_ENTRY_glClearBufferData)
+            return pixelBytes(1, 1, 1, get<2>(args), get<3>(args));
+        else if constexpr (Entry == GL_ENTRY_glTexImage2D)
+            return pixelBytes(get<3>(args), get<4>(args), 1, get<6>(args), get<7>(args));
+        else if constexpr (Entry == GL_ENTRY_glTexImage3D)
+            return pixelBytes(get<3>(args), get<4>(args), get<5>(args), get<7>(args), get<8>(args));
+        else if constexpr (Entry == GL_ENTRY_glTexSubImage2D)
+            return pixelBytes(get<4>(args), get<5>(args), 1, get<6>(args), get<7>(args));
+        else if constexpr (Entry == GL_ENTRY_glTexSubImage3D)
+            return pixelBytes(get<5>(args), get<6>(args), get<7>(args), get<8>(args), get<9>(args));
+        else if constexpr (Entry == GL_ENTRY_glUniform2fv || Entry == GL_ENTRY_glUniform3fv || Entry == GL_ENTRY_glUniform4fv)
+            return get<1>(args) * (Entry == GL_ENTRY_glUniform2fv ? 2 : Entry == GL_ENTRY_glUniform3fv ? 3 : 4) * sizeof(GLfloat);
+        else if constexpr (Entry == GL_ENTRY_glUniformMatrix2fv || Entry == GL_ENTRY_glUniformMatrix3fv
+                           || Entry == GL_ENTRY_glUniformMatrix4fv)
+            return get<1>(args) * (Entry == GL_ENTRY_glUniformMatrix2fv ? 4 : Entry == GL_ENTRY_glUniformMatrix3fv ? 9 : 16) * sizeof(GLfloat);
+        else
+        {
+            // the glDelete* calls, an array of names
+            static_assert(ArgSpec(Entry, 1).kind == GLArg::Data, "DataSize doesn't know this entry point");
+            return get<0>(args) * sizeof(GLuint);
+        }
+    }
+
+    // rows start on GL_UNPACK_ALIGNMENT, material.h drops it to 1 for odd widths
+    static uint64_t pixelBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type)
+    {
+        unsigned int components = 4;
+        switch (format)
+        {
+        case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: components = 1; break;
+        case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL: components = 2; break;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: components = 3; break;
+        default: break;
+        }
+        unsigned int size = 1;
+        switch (type)
+        {
+        case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: size = 2; break;
+        case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: size = 4; break;
+        // packed types hold every component in one value
+        case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_2_10_10_10_REV: components = 1; size = 4; break;
+        default: break;
+        }
+        uint64_t rows = static_cast<uint64_t>(height) * depth;
+        if (width <= 0 || rows == 0)
+            return 0;
+        uint64_t row = static_cast<uint64_t>(width) * components * size;
+        uint64_t stride = (row + unpackAlignment - 1) / unpackAlignment * unpackAlignment;
+        return stride * (rows - 1) + row;
+    }
+
+    static void finishCapture()
+    {
+        capture.Close();
+        cout << "gl capture: loading and " << max(capture.Frames(), 1u) - 1 << " frames, " << capture.BytesWritten()
+             << " bytes written to " << capturePath << endl;
+    }
+
+    // the entry point and the arguments, before the call
+    template <unsigned int Entry, typename... Args>
+    static void captureCall(Args... values)
+    {
+        auto args = make_tuple(values...);
+        // whatever was marked as written through a mapping has to be in the file before anything that could read it
+        if constexpr (Entry == GL_ENTRY_glDrawElements || Entry == GL_ENTRY_glDrawElementsInstancedBaseInstance
+                      || Entry == GL_ENTRY_glMultiDrawElementsIndirect || Entry == GL_ENTRY_glMultiDrawElementsIndirectCount
+                      || Entry == GL_ENTRY_glDispatchCompute || Entry == GL_ENTRY_glFenceSync || Entry == GL_ENTRY_glFinish
+                      || Entry == GL_ENTRY_glFlush)
+            capture.FlushMappings();
+        else if constexpr (Entry == GL_ENTRY_glDeleteBuffers)
+        {
+            for (GLsizei i = 0; i < get<0>(args); i++)
+                capture.RemoveMappings(get<1>(args)[i]);
+        }
+        else if constexpr (Entry == GL_ENTRY_glBindBuffer)
+            captureBuffers[get<0>(args)] = get<1>(args);
+        else if constexpr (Entry == GL_ENTRY_glBindBufferBase || Entry == GL_ENTRY_glBindBufferRange)
+            captureBuffers[get<0>(args)] = get<2>(args);
+        capture.Write<uint16_t>(Entry);
+        captureArgs<Entry>(args, index_sequence_for<Args...>());
+    }
+
+    template <unsigned int Entry, typename Tuple, size_t... Index>
+    static void captureArgs(const Tuple &args, index_sequence<Index...>)
+    {
+        (captureArg<Entry, Index>(get<Index>(args), args), ...);
+    }
+
+    template <unsigned int Entry, size_t Index, typename T, typename Tuple>
+    static void captureArg(T value, const Tuple &args)
+    {
+        constexpr GLArgSpec spec = ArgSpec(Entry, Index);
+        if constexpr (!is_pointer_v<T>)
+            capture.Write(value);
+        else
+        {
+            static_assert(spec.kind != GLArg::Value, "pointer arguments need an ArgSpec");
+            capture.Write<uint64_t>(reinterpret_cast<uintptr_t>(value));
+            if (!value)
+                return;
+            if constexpr (spec.kind == GLArg::Data)
+                capture.WriteBytes(value, dataSize<Entry>(args));
+            else if constexpr (spec.kind == GLArg::String)
+                capture.WriteBytes(value, strlen(value));
+            else if constexpr (spec.kind == GLArg::Strings)
+            {
+                const GLint *lengths = get<3>(args);
+                capture.Write<uint64_t>(static_cast<uint64_t>(get<1>(args)));
+                for (GLsizei i = 0; i < get<1>(args); i++)
+                    capture.WriteBytes(value[i], lengths && lengths[i] >= 0 ? static_cast<uint64_t>(lengths[i]) : strlen(value[i]));
+            }
+        }
+    }
+
+    template <unsigned int Entry, typename R, typename... Args>
+    static void captureResult(R result, Args... values)
+    {
+        uint64_t bits;
+        if constexpr (is_pointer_v<R>)
+            bits = reinterpret_cast<uintptr_t>(result);
+        else
+            bits = static_cast<uint64_t>(result);
+        capture.Write(bits);
+        if constexpr (Entry == GL_ENTRY_glMapBufferRange)
+        {
+            auto args = make_tuple(values...);
+            if (result)
+                capture.AddMapping(bits, captureBuffers[get<0>(args)], result, static_cast<size_t>(get<2>(args)));
+        }
+    }
+
+    template <unsigned int Entry, typename... Args>
+    static void captureGenerated(Args... values)
+    {
+        if constexpr (GeneratedName(Entry) != GLName::None)
+        {
+            auto args = make_tuple(values...);
+            for (GLsizei i = 0; i < get<0>(args); i++)
+                capture.Write(get<1>(args)[i]);
+        }
+    }
+
+    // the checks for the calls that set shadowed state or upload data, everything else only gets counted
+    template <unsigned int Entry, typename... Args>
+    static void inspect(Args... values)
+    {
+        auto args = make_tuple(values...);
+        bool redundant = false;
+        if constexpr (Entry == GL_ENTRY_glUseProgram)
+        {
+            redundant = programKnown && program == get<0>(args);
+            program = get<0>(args);
+            programKnown = true;
+        }
+        else if constexpr (Entry == GL_ENTRY_glBindVertexArray)
+        {
+            redundant = vertexArrayKnown && vertexArray == get<0>(args);
+            vertexArray = get<0>(args);
+            vertexArrayKnown = true;
+            // the element array binding is part of the vertex array
+            buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        else if constexpr (Entry == GL_ENTRY_glBindBuffer)
+            redundant = update(buffers, get<0>(args), get<1>(args));
+        else if constexpr (Entry == GL_ENTRY_glBindBufferBase || Entry == GL_ENTRY_glBindBufferRange)
+        {
+            tuple<GLuint, GLintptr, GLsizeiptr> range(get<2>(args), 0, 0);
+            if constexpr (Entry == GL_ENTRY_glBindBufferRange)
+                range = make_tuple(get<2>(args), get<3>(args), get<4>(args));
+            redundant = update(indexedBuffers, make_pair(get<0>(args), get<1>(args)), range);
+            // binding to an index binds the generic target too
+            buffers[get<0>(args)] = get<2>(args);
+        }
+        else if constexpr (Entry == GL_ENTRY_glActiveTexture)
+        {
+            redundant = activeTexture == get<0>(args);
+            activeTexture = get<0>(args);
+        }
+        else if constexpr (Entry == GL_ENTRY_glBindTexture)
+            redundant = update(textures, make_pair(activeTexture, get<0>(args)), get<1>(args));
+        else if constexpr (Entry == GL_ENTRY_glEnable || Entry == GL_ENTRY_glDisable)
+            redundant = update(caps, get<0>(args), Entry == GL_ENTRY_glEnable);
+        else if constexpr (Entry == GL_ENTRY_glBindFramebuffer)
+        {
+            if (get<0>(args) == GL_FRAMEBUFFER)
+            {
+                redundant = framebuffers.count(GL_DRAW_FRAMEBUFFER) && framebuffers[GL_DRAW_FRAMEBUFFER] == get<1>(args)
+                         && framebuffers.count(GL_READ_FRAMEBUFFER) && framebuffers[GL_READ_FRAMEBUFFER] == get<1>(args);
+                framebuffers[GL_DRAW_FRAMEBUFFER] = framebuffers[GL_READ_FRAMEBUFFER] = get<1>(args);
+            }
+            else
+                redundant = update(framebuffers, get<0>(args), get<1>(args));
+        }
+        else if constexpr (Entry == GL_ENTRY_glBindRenderbuffer)
+            redundant = update(renderbuffers, get<0>(args), get<1>(args));
+        else if constexpr (Entry == GL_ENTRY_glClearColor)
+            redundant = updateValues(clearColor, {get<0>(args), get<1>(args), get<2>(args), get<3>(args)});
+        else if constexpr (Entry == GL_ENTRY_glViewport)
+            redundant = updateValues(viewport, {get<0>(args), get<1>(args), GLint(get<2>(args)), GLint(get<3>(args))});
+        else if constexpr (Entry == GL_ENTRY_glUniform1f || Entry == GL_ENTRY_glUniform1i || Entry == GL_ENTRY_glUniform1ui
+                           || Entry == GL_ENTRY_glUniform2f || Entry == GL_ENTRY_glUniform2i || Entry == GL_ENTRY_glUniform3f
+                           || Entry == GL_ENTRY_glUniform4f)
+            redundant = apply([](GLint location, auto... rest) { return updateUniformValues(location, rest...); }, args);
+        else if constexpr (Entry == GL_ENTRY_glUniform2fv || Entry == GL_ENTRY_glUniform3fv || Entry == GL_ENTRY_glUniform4fv)
+        {
+            size_t components = Entry == GL_ENTRY_glUniform2fv ? 2 : Entry == GL_ENTRY_glUniform3fv ? 3 : 4;
+            redundant = updateUniform(get<0>(args), get<2>(args), get<1>(args) * components * sizeof(GLfloat));
+        }
+        else if constexpr (Entry == GL_ENTRY_glUniformMatrix2fv || Entry == GL_ENTRY_glUniformMatrix3fv
+                           || Entry == GL_ENTRY_glUniformMatrix4fv)
+        {
+            size_t components = Entry == GL_ENTRY_glUniformMatrix2fv ? 4 : Entry == GL_ENTRY_glUniformMatrix3fv ? 9 : 16;
+            // the transpose flag changes the value as much as the data does
+            GLboolean transpose = get<2>(args);
+            vector<unsigned char> bytes(sizeof(GLboolean) + get<1>(args) * components * sizeof(GLfloat));
+            memcpy(bytes.data(), &transpose, sizeof(GLboolean));
+            memcpy(bytes.data() + sizeof(GLboolean), get<3>(args), bytes.size() - sizeof(GLboolean));
+            redundant = updateUniform(get<0>(args), bytes.data(), bytes.size());
+        }
+        else if constexpr (Entry == GL_ENTRY_glDeleteBuffers || Entry == GL_ENTRY_glDeleteTextures
+                           || Entry == GL_ENTRY_glDeleteVertexArrays || Entry == GL_ENTRY_glDeleteFramebuffers
+                           || Entry == GL_ENTRY_glDeleteRenderbuffers || Entry == GL_ENTRY_glDeleteProgram
+                           || Entry == GL_ENTRY_glLinkProgram)
+            forgetState();
+        else if constexpr (Entry == GL_ENTRY_glPixelStorei)
+        {
+            if (get<0>(args) == GL_UNPACK_ALIGNMENT)
+                unpackAlignment = get<1>(args);
+        }
+        else if constexpr (Entry == GL_ENTRY_glBufferData || Entry == GL_ENTRY_glBufferStorage)
+        {
+            // null data only allocates
+            if (get<2>(args))
+                current.bytesUploaded += dataSize<Entry>(args);
+        }
+        else if constexpr (Entry == GL_ENTRY_glTexImage2D || Entry == GL_ENTRY_glTexImage3D || Entry == GL_ENTRY_glTexSubImage2D
+                           || Entry == GL_ENTRY_glTexSubImage3D)
+        {
+            // the pixels are the last argument
+            if (get<sizeof...(Args) - 1>(args))
+                current.bytesUploaded += dataSize<Entry>(args);
+        }
+        else if constexpr (Entry == GL_ENTRY_glBufferSubData)
+            current.bytesUploaded += dataSize<Entry>(args);
+        if (redundant)
+            redundantCall(Entry);
+    }
+};
+
+#endif
@@ -0,0 +1,400 @@
+// replays a GL capture from learnOpenGL --capture on a headless EGL context, timing every call in the driver. Prints
+// the loading, each frame and the entry points and calls that took longest; --calls writes every call's time as CSV
+// for bisecting a slow frame, --top sets how many entry points and calls are listed.
+#include <glad/glad.h>
+
+#include "gl_capture.h"
+#include "gl_interceptor.h"
+#include "headless.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct CallTiming {
+    unsigned int frame; // 0 for the loading
+    unsigned int call;  // in the frame
+    uint16_t entry;     // index into the capture's entry points
+    uint64_t nanoseconds;
+};
+
+struct FrameTiming {
+    unsigned int calls = 0;
+    uint64_t nanoseconds = 0;       // inside the driver, the calls themselves
+    uint64_t finishNanoseconds = 0; // glFinish at the end of the frame, the GPU catching up
+};
+
+// Decodes a capture's calls and makes them again. Names, syncs, uniform locations and mapped pointers are the
+// replay's own, mapped from the captured ones as the calls that created them come by. The window's framebuffer,
+// 0, is the offscreen target.
+class Replay {
+public:
+    // room for each output argument, more than any query or info log the renderer asks for
+    static constexpr size_t OUTPUT_SIZE = 1 << 16;
+    static constexpr size_t MAX_ARGUMENTS = 12;
+
+    Replay(GLCaptureReader &reader, GLuint framebuffer) : reader(reader), framebuffer(framebuffer), outputs(OUTPUT_SIZE * MAX_ARGUMENTS) {}
+
+    void BeginCall()
+    {
+        blobs.clear();
+        strings.clear();
+    }
+
+    template <unsigned int Entry, size_t Index, typename T>
+    T Arg()
+    {
+        static_assert(Index < MAX_ARGUMENTS, "more arguments than Replay has outputs for");
+        constexpr GLArgSpec spec = GLInterceptor::ArgSpec(Entry, Index);
+        if constexpr (!is_pointer_v<T>)
+        {
+            T value = reader.Read<T>();
+            if constexpr (spec.name == GLName::Location)
+                return location(value);
+            else if constexpr (spec.name != GLName::None)
+            {
+                if constexpr (spec.name == GLName::Program)
+                {
+                    lastProgram = value;
+                    if constexpr (Entry == GL_ENTRY_glUseProgram)
+                        currentProgram = value;
+                }
+                return static_cast<T>(name(spec.name, value));
+            }
+            else
+                return value;
+        }
+        else
+        {
+            uint64_t bits = reader.Read<uint64_t>();
+            if constexpr (spec.kind == GLArg::Offset)
+                return reinterpret_cast<T>(static_cast<uintptr_t>(spec.name == GLName::None ? bits : name(spec.name, bits)));
+            else if constexpr (spec.kind == GLArg::Output)
+                return reinterpret_cast<T>(outputs.data() + Index * OUTPUT_SIZE);
+            else if constexpr (spec.kind == GLArg::Unused)
+                return nullptr;
+            else
+            {
+                if (!bits)
+                    return nullptr;
+                if constexpr (spec.kind == GLArg::Strings)
+                {
+                    uint64_t count = reader.Read<uint64_t>();
+                    for (uint64_t i = 0; i < count; i++)
+                        blobs.push_back(reader.ReadBytes());
+                    for (const vector<char> &text : blobs)
+                        strings.push_back(text.data());
+                    return reinterpret_cast<T>(strings.data());
+                }
+                else
+                {
+                    blobs.push_back(reader.ReadBytes());
+                    vector<char> &data = blobs.back();
+                    // arrays of names to delete
+                    if constexpr (spec.name != GLName::None)
+                    {
+                        for (size_t offset = 0; offset + sizeof(GLuint) < data.size(); offset += sizeof(GLuint))
+                        {
+                            GLuint captured;
+                            memcpy(&captured, data.data() + offset, sizeof(GLuint));
+                            GLuint replayed = static_cast<GLuint>(name(spec.name, captured));
+                            memcpy(data.data() + offset, &replayed, sizeof(GLuint));
+                        }
+                    }
+                    return reinterpret_cast<T>(data.data());
+                }
+            }
+        }
+    }
+
+    template <unsigned int Entry, typename R, typename Tuple>
+    void Result(R result, const Tuple &args)
+    {
+        uint64_t captured = reader.Read<uint64_t>();
+        constexpr GLName kind = GLInterceptor::ReturnName(Entry);
+        if constexpr (kind == GLName::Location)
+            locations[make_pair(lastProgram, static_cast<GLint>(captured))] = static_cast<GLint>(result);
+        else if constexpr (kind != GLName::None)
+        {
+            if constexpr (is_pointer_v<R>)
+                names[make_pair(kind, captured)] = reinterpret_cast<uintptr_t>(result);
+            else
+                names[make_pair(kind, captured)] = static_cast<uint64_t>(result);
+        }
+        Generated<Entry>(args);
+    }
+
+    template <unsigned int Entry, typename Tuple>
+    void Generated(const Tuple &args)
+    {
+        constexpr GLName kind = GLInterceptor::GeneratedName(Entry);
+        if constexpr (kind != GLName::None)
+        {
+            for (GLsizei i = 0; i < get<0>(args); i++)
+                names[make_pair(kind, static_cast<uint64_t>(reader.Read<GLuint>()))] = get<1>(args)[i];
+        }
+    }
+
+    // bytes the renderer wrote through a mapped pointer, written through the replay's
+    bool Memory()
+    {
+        uint64_t mapping = reader.Read<uint64_t>();
+        uint64_t offset = reader.Read<uint64_t>();
+        vector<char> data = reader.ReadBytes();
+        auto found = names.find(make_pair(GLName::Mapping, mapping));
+        if (found == names.end())
+        {
+            cout << "ERROR::REPLAY:: memory written through a mapping that was never made" << endl;
+            return false;
+        }
+        memcpy(reinterpret_cast<char*>(static_cast<uintptr_t>(found->second)) + offset, data.data(), data.size() - 1);
+        return true;
+    }
+
+private:
+    GLCaptureReader &reader;
+    GLuint framebuffer;
+    vector<char> outputs;
+    vector<vector<char>> blobs;   // the call's data, until the next call
+    vector<const char*> strings;  // pointers into blobs for glShaderSource
+    map<pair<GLName, uint64_t>, uint64_t> names; // (kind, captured) -> replayed
+    map<pair<GLuint, GLint>, GLint> locations;   // (captured program, captured location) -> replayed
+    GLuint lastProgram = 0, currentProgram = 0;  // captured names
+
+    uint64_t name(GLName kind, uint64_t captured) const
+    {
+        if (captured == 0)
+            return kind == GLName::Framebuffer ? framebuffer : 0;
+        auto found = names.find(make_pair(kind, captured));
+        return found != names.end() ? found->second : captured;
+    }
+
+    GLint location(GLint captured) const
+    {
+        auto found = locations.find(make_pair(currentProgram, captured));
+        return found != locations.end() ? found->second : captured;
+    }
+};
+
+// one call decoded and made through glad's pointer, returns the nanoseconds it took
+template <auto Slot, unsigned int Entry, typename Pointer = remove_pointer_t<decltype(Slot)>>
+struct Replayer;
+
+template <auto Slot, unsigned int Entry, typename R, typename... Args>
+struct Replayer<Slot, Entry, R (APIENTRY *)(Args...)> {
+    static uint64_t Call(Replay &replay)
+    {
+        return call(replay, index_sequence_for<Args...>());
+    }
+
+    template <size_t... Index>
+    static uint64_t call(Replay &replay, index_sequence<Index...>)
+    {
+        replay.BeginCall();
+        // braces, so the arguments are read in order
+        tuple<Args...> args{replay.template Arg<Entry, Index, Args>()...};
+        auto start = chrono::steady_clock::now();
+        if constexpr (is_void_v<R>)
+        {
+            apply(*Slot, args);
+            uint64_t nanoseconds = elapsed(start);
+            replay.Generated<Entry>(args);
+            return nanoseconds;
+        }
+        else
+        {
+            R result = apply(*Slot, args);
+            uint64_t nanoseconds = elapsed(start);
+            replay.Result<Entry>(result, args);
+            return nanoseconds;
+        }
+    }
+
+    static uint64_t elapsed(chrono::steady_clock::time_point start)
+    {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+};
+
+struct ReplayEntry {
+    const char *name;
+    uint64_t (*call)(Replay &);
+    bool available; // the context has it
+};
+
+struct EntryTotal {
+    unsigned int calls = 0;
+    uint64_t nanoseconds = 0;
+};
+
+int main(int argc, char **argv)
+{
+    string capturePath, callsPath;
+    unsigned int top = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc)
+            callsPath = argv[++i];
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+            top = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (argv[i][0] != '-' && capturePath.empty())
+            capturePath = argv[i];
+        else
+        {
+            capturePath.clear();
+            break;
+        }
+    }
+    if (capturePath.empty())
+    {
+        cout << "usage: " << argv[0] << " capture [--calls file.csv] [--top count]" << endl;
+        return -1;
+    }
+
+    GLCaptureReader reader;
+    if (!reader.Open(capturePath))
+    {
+        cout << "ERROR::REPLAY:: can't read " << capturePath << ": " << reader.Error() << endl;
+        return -1;
+    }
+    HeadlessContext context;
+    if (!context.IsValid() || !gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+    {
+        cout << "ERROR::REPLAY:: no headless GL context" << endl;
+        return -1;
+    }
+    OffscreenTarget target(static_cast<int>(reader.width), static_cast<int>(reader.height));
+    target.Bind();
+    cout << "replay: " << capturePath << ", " << reader.width << "x" << reader.height << " on " << glGetString(GL_RENDERER)
+         << ", OpenGL " << glGetString(GL_VERSION) << endl;
+
+    // the capture's entry points by name, a build with a different list can still replay it
+    const ReplayEntry replayers[] = {
+#define GL_REPLAY_ENTRY(name) {#name, &Replayer<&glad_##name, GL_ENTRY_##name>::Call, glad_##name != nullptr},
+        GL_INTERCEPTED_FUNCTIONS(GL_REPLAY_ENTRY)
+#undef GL_REPLAY_ENTRY
+    };
+    vector<const ReplayEntry*> dispatch(reader.entries.size(), nullptr);
+    for (size_t i = 0; i < reader.entries.size(); i++)
+        for (const ReplayEntry &replayer : replayers)
+            if (reader.entries[i] == replayer.name)
+                dispatch[i] = &replayer;
+
+    Replay replay(reader, target.Framebuffer());
+    vector<CallTiming> calls;
+    vector<FrameTiming> frames(1);
+    vector<EntryTotal> totals(reader.entries.size());
+    uint16_t record;
+    while (reader.Next(record))
+    {
+        unsigned int frame = static_cast<unsigned int>(frames.size() - 1);
+        if (record == GL_CAPTURE_FRAME)
+        {
+            auto start = chrono::steady_clock::now();
+            glFinish();
+            frames.back().finishNanoseconds = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+            GLenum error = glGetError();
+            if (error != GL_NO_ERROR)
+                cout << "ERROR::REPLAY:: " << (frame ? "frame " + to_string(frame) : string("loading")) << " left GL error 0x"
+                     << hex << error << dec << endl;
+            frames.emplace_back();
+            continue;
+        }
+        if (record == GL_CAPTURE_MEMORY)
+        {
+            if (!replay.Memory())
+                return -1;
+            continue;
+        }
+        if (record >= dispatch.size() || !dispatch[record] || !dispatch[record]->available)
+        {
+            cout << "ERROR::REPLAY:: the capture calls " << (record < reader.entries.size() ? reader.entries[record] : to_string(record))
+                 << ", which this build can't replay" << endl;
+            return -1;
+        }
+        uint64_t nanoseconds = dispatch[record]->call(replay);
+        if (!reader.Good())
+        {
+            cout << "ERROR::REPLAY:: the capture ends in the middle of " << reader.entries[record] << endl;
+            break;
+        }
+        calls.push_back(CallTiming{frame, frames.back().calls, record, nanoseconds});
+        frames.back().calls++;
+        frames.back().nanoseconds += nanoseconds;
+        if (frame > 0)
+        {
+            totals[record].calls++;
+            totals[record].nanoseconds += nanoseconds;
+        }
+    }
+    // calls after the last frame ended belong to a frame the capture stopped in the middle of
+    if (frames.back().calls == 0)
+        frames.pop_back();
+
+    cout << "loading: " << frames[0].calls << " calls, " << frames[0].nanoseconds / 1.0e6 << "ms in the driver, "
+         << frames[0].finishNanoseconds / 1.0e6 << "ms finishing" << endl;
+    uint64_t frameNanoseconds = 0, finishNanoseconds = 0;
+    for (size_t i = 1; i < frames.size(); i++)
+    {
+        cout << "frame " << i << ": " << frames[i].calls << " calls, " << frames[i].nanoseconds / 1.0e6 << "ms in the driver, "
+             << frames[i].finishNanoseconds / 1.0e6 << "ms finishing" << endl;
+        frameNanoseconds += frames[i].nanoseconds;
+        finishNanoseconds += frames[i].finishNanoseconds;
+    }
+    size_t frameCount = frames.size() - 1;
+    if (frameCount > 0)
+        cout << "frames: " << frameCount << ", average " << frameNanoseconds / 1.0e6 / frameCount << "ms in the driver, "
+             << finishNanoseconds / 1.0e6 / frameCount << "ms finishing" << endl;
+
+    // over the frames, the loading would drown everything else in uploads
+    vector<size_t> order;
+    for (size_t i = 0; i < totals.size(); i++)
+        if (totals[i].calls > 0)
+            order.push_back(i);
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return totals[a].nanoseconds > totals[b].nanoseconds; });
+    cout << "entry points by time in the driver over the frames:" << endl;
+    for (size_t i = 0; i < order.size() && i < top; i++)
+    {
+        const EntryTotal &total = totals[order[i]];
+        cout << "    " << reader.entries[order[i]] << ": " << total.calls << " calls, " << total.nanoseconds / 1.0e6 << "ms, "
+             << total.nanoseconds / 1000.0 / total.calls << "us each" << endl;
+    }
+
+    vector<CallTiming> slowest;
+    for (const CallTiming &call : calls)
+        if (call.frame > 0)
+            slowest.push_back(call);
+    size_t listed = min<size_t>(top, slowest.size());
+    partial_sort(slowest.begin(), slowest.begin() + listed, slowest.end(),
+                 [](const CallTiming &a, const CallTiming &b) { return a.nanoseconds > b.nanoseconds; });
+    cout << "slowest calls:" << endl;
+    for (size_t i = 0; i < listed; i++)
+        cout << "    frame " << slowest[i].frame << " call " << slowest[i].call << " " << reader.entries[slowest[i].entry] << ": "
+             << slowest[i].nanoseconds / 1000.0 << "us" << endl;
+
+    if (!callsPath.empty())
+    {
+        ofstream csv(callsPath);
+        if (!csv)
+        {
+            cout << "ERROR::REPLAY:: can't write " << callsPath << endl;
+            return -1;
+        }
+        csv << "frame,call,entry,nanoseconds\n";
+        for (const CallTiming &call : calls)
+            csv << call.frame << "," << call.call << "," << reader.entries[call.entry] << "," << call.nanoseconds << "\n";
+        cout << "replay: " << calls.size() << " call timings written to " << callsPath << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,353 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "bindings.h"
+#include "bounds.h"
+#include "frustum.h"
+#include "material.h"
+#include "mesh.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// per-instance data the cull pass and the vertex shader read (std430)
+struct GpuInstance {
+    glm::mat4 model;
+    glm::vec4 boundsMin; // world space, w unused
+    glm::vec4 boundsMax;
+    unsigned int mesh;
+    unsigned int material;
+    unsigned int padding[2];
+};
+
+// where a mesh lives in the shared geometry buffers (std430)
+struct GpuMeshInfo {
+    unsigned int count;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int padding;
+};
+
+// layout fixed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// GPU-driven rendering: instance bounds live in an SSBO and a compute pass does frustum culling and Hi-Z
+// occlusion culling against the previous frame's depth pyramid, appending a DrawElementsIndirectCommand per
+// surviving instance. The commands are drawn with a single glMultiDrawElementsIndirectCount (GL 4.6) or, on
+// 4.3-4.5, glMultiDrawElementsIndirect over a buffer whose unused tail has been zeroed.
+//
+// All meshes share one vertex/index buffer so one multi-draw covers them; their materials must come from a
+// MaterialLibrary since textures can't change between the sub-draws. Per frame the CPU issues a fixed number of
+// calls however many instances there are, only instances changed through SetTransform are re-uploaded.
+//
+// Usage: AddMesh()/AddInstance(), Upload() once, then per frame Cull(), SetDepthViewProjection() with the camera
+// the frame is drawn with, Draw() and, after the frame has been rendered, UpdateDepthPyramid().
+class GpuCuller {
+public:
+    GpuCuller(const char *cullPath, const char *hizPath) : cullShader(cullPath), hizShader(hizPath)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceBuffer);
+        glGenBuffers(1, &identityBuffer);
+        glGenBuffers(1, &meshBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &countBuffer);
+    }
+
+    // needs the context it was created in still current
+    ~GpuCuller()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        unsigned int buffers[] = {VBO, EBO, instanceBuffer, identityBuffer, meshBuffer, commandBuffer, countBuffer};
+        glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteTextures(1, &hizTexture);
+        glDeleteProgram(cullShader.ID);
+        glDeleteProgram(hizShader.ID);
+    }
+
+    GpuCuller(const GpuCuller &) = delete;
+    GpuCuller &operator=(const GpuCuller &) = delete;
+
+    // appends the mesh to the shared geometry and returns its index
+    unsigned int AddMesh(const Mesh &mesh)
+    {
+        GpuMeshInfo info;
+        info.count = static_cast<unsigned int>(mesh.indices.size());
+        info.firstIndex = static_cast<unsigned int>(indices.size());
+        info.baseVertex = static_cast<int>(vertices.size());
+        info.padding = 0;
+        vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        meshes.push_back(info);
+        meshBounds.push_back(mesh.bounds.box);
+        meshMaterials.push_back(static_cast<unsigned int>(max(0, mesh.MaterialIndex)));
+        return static_cast<unsigned int>(meshes.size() - 1);
+    }
+
+    // places a mesh in the world and returns the instance index
+    unsigned int AddInstance(unsigned int mesh, const glm::mat4 &model)
+    {
+        GpuInstance instance;
+        instance.mesh = mesh;
+        instance.material = meshMaterials[mesh];
+        instance.padding[0] = instance.padding[1] = 0;
+        instances.push_back(instance);
+        setTransform(static_cast<unsigned int>(instances.size() - 1), model);
+        return static_cast<unsigned int>(instances.size() - 1);
+    }
+
+    // moves an instance, only the changed range is uploaded by the next Cull
+    void SetTransform(unsigned int instance, const glm::mat4 &model)
+    {
+        setTransform(instance, model);
+        dirtyBegin = min(dirtyBegin, instance);
+        dirtyEnd = max(dirtyEnd, instance + 1);
+    }
+
+    // creates the GPU buffers, call once after all meshes and instances have been added
+    void Upload()
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        // same attribute layout as Mesh::setupMesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+
+        // identity table so the instanced attribute reads back each sub-draw's baseInstance, i.e. its instance
+        vector<unsigned int> identity(instances.size());
+        for (unsigned int i = 0; i < identity.size(); i++)
+            identity[i] = i;
+        glBindBuffer(GL_ARRAY_BUFFER, identityBuffer);
+        glBufferData(GL_ARRAY_BUFFER, identity.size() * sizeof(unsigned int), identity.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(MATERIAL_INDEX_ATTRIBUTE);
+        glVertexAttribIPointer(MATERIAL_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glVertexAttribDivisor(MATERIAL_INDEX_ATTRIBUTE, 1);
+        glBindVertexArray(0);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(GpuInstance), instances.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, meshes.size() * sizeof(GpuMeshInfo), meshes.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        uploadedInstances = static_cast<unsigned int>(instances.size());
+        dirtyBegin = ~0u;
+        dirtyEnd = 0;
+    }
+
+    // runs the cull pass, the resulting commands are what Draw() submits. The frustum test uses projection * view,
+    // which may be wider than the camera the frame is drawn with.
+    void Cull(const glm::mat4 &projection, const glm::mat4 &view)
+    {
+        if (dirtyBegin < dirtyEnd)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(GpuInstance),
+                            (dirtyEnd - dirtyBegin) * sizeof(GpuInstance), &instances[dirtyBegin]);
+            dirtyBegin = ~0u;
+            dirtyEnd = 0;
+        }
+
+        unsigned int zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        if (!GLAD_GL_VERSION_4_6)
+        {
+            // without a GPU-side draw count every slot is drawn, so the ones the pass doesn't fill must be empty
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        Frustum frustum = Frustum::FromMatrix(projection * view);
+        cullShader.use();
+        glUniform1ui(glGetUniformLocation(cullShader.ID, "instanceCount"), uploadedInstances);
+        glUniform4fv(glGetUniformLocation(cullShader.ID, "frustumPlanes"), Frustum::PLANE_COUNT, &frustum.planes[0][0]);
+        cullShader.setBool("useHiZ", hizLevels > 0);
+        if (hizLevels > 0)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hizTexture);
+            cullShader.setInt("hiz", 0);
+            glUniform2i(glGetUniformLocation(cullShader.ID, "hizSize"), hizWidth, hizHeight);
+            cullShader.setInt("hizLevels", hizLevels);
+            cullShader.setMat4("hizViewProjection", hizViewProjection);
+        }
+        bindBuffers();
+        glDispatchCompute((uploadedInstances + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // the camera the frame's depth is rendered with, which the next UpdateDepthPyramid tags the pyramid with. Not
+    // necessarily Cull's: a late-latched view or a culling frustum with a margin would reproject the bounds wrong.
+    void SetDepthViewProjection(const glm::mat4 &viewProjection)
+    {
+        drawnViewProjection = viewProjection;
+    }
+
+    // draws every command the last Cull produced, the shader's program is expected to be in use
+    void Draw()
+    {
+        bindBuffers();
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (GLAD_GL_VERSION_4_6)
+        {
+            glBindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0, uploadedInstances, 0);
+            glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        }
+        else
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, uploadedInstances, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // copies the depth buffer of the frame just drawn into the pyramid the next Cull tests against, the
+    // default framebuffer (or whatever is bound for reading) must be width x height
+    void UpdateDepthPyramid(int width, int height)
+    {
+        if (width <= 0 || height <= 0)
+            return;
+        if (width != hizWidth || height != hizHeight)
+            createPyramid(width, height);
+
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+        hizShader.use();
+        hizShader.setInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+        int levelWidth = width, levelHeight = height;
+        for (int level = 0; level < hizLevels; level++)
+        {
+            bool first = level == 0;
+            int sourceWidth = levelWidth, sourceHeight = levelHeight;
+            // mip sizes round down, hiz.comp folds the odd texel into the last row/column
+            if (!first)
+            {
+                levelWidth = max(1, levelWidth / 2);
+                levelHeight = max(1, levelHeight / 2);
+            }
+            glBindTexture(GL_TEXTURE_2D, first ? depthTexture : hizTexture);
+            hizShader.setBool("firstLevel", first);
+            hizShader.setInt("sourceLevel", first ? 0 : level - 1);
+            glUniform2i(glGetUniformLocation(hizShader.ID, "sourceSize"), sourceWidth, sourceHeight);
+            glUniform2i(glGetUniformLocation(hizShader.ID, "destinationSize"), levelWidth, levelHeight);
+            glBindImageTexture(0, hizTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        hizViewProjection = drawnViewProjection;
+    }
+
+    // how many instances the last Cull kept, read back from the GPU so it waits for the pass to finish
+    unsigned int ReadDrawCount() const
+    {
+        unsigned int count = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &count);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return count;
+    }
+
+    unsigned int InstanceCount() const { return static_cast<unsigned int>(instances.size()); }
+    const GpuInstance &GetInstance(unsigned int instance) const { return instances[instance]; }
+
+private:
+    Shader cullShader, hizShader;
+    unsigned int VAO, VBO, EBO;
+    unsigned int instanceBuffer, identityBuffer, meshBuffer, commandBuffer, countBuffer;
+    unsigned int depthTexture = 0, hizTexture = 0;
+    int hizWidth = 0, hizHeight = 0, hizLevels = 0;
+    glm::mat4 drawnViewProjection = glm::mat4(1.0f); // camera of the frame being drawn
+    glm::mat4 hizViewProjection = glm::mat4(1.0f);   // camera the pyramid was rendered with
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<GpuMeshInfo> meshes;
+    vector<AABB> meshBounds;
+    vector<unsigned int> meshMaterials;
+    vector<GpuInstance> instances;
+    unsigned int uploadedInstances = 0;
+    unsigned int dirtyBegin = ~0u, dirtyEnd = 0;
+
+    void setTransform(unsigned int instance, const glm::mat4 &model)
+    {
+        AABB bounds = meshBounds[instances[instance].mesh].Transformed(model);
+        instances[instance].model = model;
+        instances[instance].boundsMin = glm::vec4(bounds.min, 1.0f);
+        instances[instance].boundsMax = glm::vec4(bounds.max, 1.0f);
+    }
+
+    void bindBuffers() const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_INSTANCES_BINDING, instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_MESHES_BINDING, meshBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_COMMANDS_BINDING, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_DRAW_COUNT_BINDING, countBuffer);
+    }
+
+    void createPyramid(int width, int height)
+    {
+        if (depthTexture)
+        {
+            glDeleteTextures(1, &depthTexture);
+            glDeleteTextures(1, &hizTexture);
+        }
+        hizWidth = width;
+        hizHeight = height;
+        hizLevels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(max(width, height)))));
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &hizTexture);
+        glBindTexture(GL_TEXTURE_2D, hizTexture);
+        glTexStorage2D(GL_TEXTURE_2D, hizLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif
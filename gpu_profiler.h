@@ -0,0 +1,247 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// rolling average of one GPU zone, milliseconds per frame it appeared in
+struct GpuZoneAverage {
+    const ProfileZone *zone;
+    double milliseconds;
+    unsigned int samples;
+};
+
+// Times passes on the GPU with timestamp queries and feeds them to the CPU profiler's trace on a "GPU" track.
+//
+// Each scope puts a GL_TIMESTAMP query at its start and end; timestamps rather than GL_TIME_ELAPSED because
+// elapsed-time queries can't nest and passes contain per-model scopes. Queries come from a pool per frame slot and
+// are read back FRAME_LATENCY frames later, when the frame pacer has long since waited for that frame's fence, so
+// reading them never stalls. A frame whose queries still aren't available is dropped rather than waited for.
+// GPU timestamps are put on the CPU timeline with an offset measured at BeginFrame, the GPU clock read through
+// glGetInteger64v(GL_TIMESTAMP) against Profiler::Now(). Per zone the last AVERAGE_FRAMES frames are averaged.
+//
+// Per frame: BeginFrame() once the pacer has waited, scopes with GPU_PROFILE_ZONE, EndFrame() before swapping.
+class GpuProfiler {
+public:
+    // frames between issuing a frame's queries and reading them, more than the pacer keeps in flight
+    static constexpr unsigned int FRAME_LATENCY = 4;
+    static constexpr unsigned int AVERAGE_FRAMES = 64;
+
+    GpuProfiler() : frames(FRAME_LATENCY)
+    {
+        track = Profiler::AddTrack("GPU");
+    }
+
+    ~GpuProfiler()
+    {
+        for (Frame &frame : frames)
+            if (!frame.queries.empty())
+                glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+    }
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    // reads back the frame this slot held FRAME_LATENCY frames ago and starts recording into it
+    void BeginFrame()
+    {
+        Frame &frame = frames[current];
+        collect(frame);
+        frame.scopes.clear();
+        frame.used = 0;
+        frame.open = 0;
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        frame.clockOffset = static_cast<int64_t>(Profiler::Now()) - gpuNow;
+    }
+
+    void EndFrame()
+    {
+        if (frames[current].open > 0)
+            cout << "ERROR::GPU_PROFILER:: " << frames[current].open << " scopes still open at the end of the frame" << endl;
+        current = (current + 1) % FRAME_LATENCY;
+    }
+
+    // returns the scope to End
+    unsigned int Begin(const ProfileZone *zone)
+    {
+        Frame &frame = frames[current];
+        Scope scope;
+        scope.zone = zone;
+        scope.begin = query(frame);
+        frame.scopes.push_back(scope);
+        frame.open++;
+        return static_cast<unsigned int>(frame.scopes.size() - 1);
+    }
+
+    void End(unsigned int scope)
+    {
+        Frame &frame = frames[current];
+        frame.scopes[scope].end = query(frame);
+        frame.open--;
+    }
+
+    // in order of first appearance
+    vector<GpuZoneAverage> Averages() const
+    {
+        vector<GpuZoneAverage> result;
+        for (const Rolling &rolling : averages)
+        {
+            unsigned int samples = min<unsigned int>(rolling.count, AVERAGE_FRAMES);
+            double total = 0.0;
+            for (unsigned int i = 0; i < samples; i++)
+                total += rolling.milliseconds[i];
+            result.push_back(GpuZoneAverage{rolling.zone, samples ? total / samples : 0.0, samples});
+        }
+        return result;
+    }
+
+    void Print() const
+    {
+        cout << "gpu passes:";
+        for (const GpuZoneAverage &average : Averages())
+            cout << " " << average.zone->name << " " << average.milliseconds << "ms";
+        cout << " (average of the last " << AVERAGE_FRAMES << " frames, " << droppedFrames << " frames dropped)" << endl;
+    }
+
+    // frames whose queries weren't ready when their slot came round again
+    unsigned int DroppedFrames() const { return droppedFrames; }
+
+private:
+    struct Scope {
+        const ProfileZone *zone = nullptr;
+        unsigned int begin = 0, end = 0; // indices into the frame's queries
+    };
+
+    struct Frame {
+        vector<GLuint> queries; // the pool, grows to the most scopes a frame has had
+        unsigned int used = 0;
+        vector<Scope> scopes;
+        int open = 0;
+        int64_t clockOffset = 0; // add to a GPU timestamp for Profiler::Now() time
+    };
+
+    struct Rolling {
+        const ProfileZone *zone;
+        double milliseconds[AVERAGE_FRAMES];
+        unsigned int count;
+    };
+
+    vector<Frame> frames;
+    unsigned int current = 0;
+    unsigned int track;
+    vector<Rolling> averages;
+    unsigned int droppedFrames = 0;
+
+    unsigned int query(Frame &frame)
+    {
+        if (frame.used == frame.queries.size())
+        {
+            GLuint id = 0;
+            glGenQueries(1, &id);
+            frame.queries.push_back(id);
+        }
+        glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+        return frame.used++;
+    }
+
+    void collect(Frame &frame)
+    {
+        if (frame.used == 0)
+            return;
+        // queries complete in order, the last one being ready means they all are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            droppedFrames++;
+            return;
+        }
+
+        vector<GLuint64> timestamps(frame.used);
+        for (unsigned int i = 0; i < frame.used; i++)
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+
+        // a zone may appear several times a frame, its average is of the frame's total
+        vector<double> totals(averages.size(), 0.0);
+        vector<bool> appeared(averages.size(), false);
+        bool tracing = Profiler::IsEnabled();
+        for (const Scope &scope : frame.scopes)
+        {
+            uint64_t begin = timestamps[scope.begin], end = max(timestamps[scope.end], timestamps[scope.begin]);
+            if (tracing)
+            {
+                int64_t start = static_cast<int64_t>(begin) + frame.clockOffset;
+                uint64_t cpuStart = static_cast<uint64_t>(max<int64_t>(start, 0));
+                Profiler::RecordOn(track, scope.zone, cpuStart, cpuStart + (end - begin));
+            }
+            size_t index = rollingIndex(scope.zone);
+            if (index >= totals.size())
+            {
+                totals.resize(index + 1, 0.0);
+                appeared.resize(index + 1, false);
+            }
+            totals[index] += (end - begin) / 1.0e6;
+            appeared[index] = true;
+        }
+        for (size_t i = 0; i < totals.size(); i++)
+        {
+            if (!appeared[i])
+                continue;
+            Rolling &rolling = averages[i];
+            rolling.milliseconds[rolling.count % AVERAGE_FRAMES] = totals[i];
+            rolling.count++;
+        }
+    }
+
+    size_t rollingIndex(const ProfileZone *zone)
+    {
+        for (size_t i = 0; i < averages.size(); i++)
+            if (averages[i].zone == zone)
+                return i;
+        averages.push_back(Rolling{zone, {}, 0});
+        return averages.size() - 1;
+    }
+};
+
+// times the scope it's declared in on the GPU, does nothing when either the profiler or the zone is null
+class GpuScope {
+public:
+    GpuScope(GpuProfiler *profiler, const ProfileZone *zone) : profiler(zone ? profiler : nullptr)
+    {
+        if (this->profiler)
+            scope = this->profiler->Begin(zone);
+    }
+
+    ~GpuScope()
+    {
+        if (profiler)
+            profiler->End(scope);
+    }
+
+    GpuScope(const GpuScope &) = delete;
+    GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+    GpuProfiler *profiler;
+    unsigned int scope = 0;
+};
+
+#ifdef LEARNOPENGL_NO_PROFILER
+#define GPU_PROFILE_ZONE(profiler, name)
+#else
+#define GPU_PROFILE_ZONE(profiler, name)                                                                      \
+    static constexpr ProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__){name, __FILE__, __LINE__};        \
+    GpuScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, &PROFILE_CONCAT(gpuProfileZone, __LINE__))
+#endif
+
+#endif
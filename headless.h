@@ -0,0 +1,157 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+// no window system, keep the EGL headers from pulling in X11
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// An OpenGL context with no window or display, for running the renderer on build machines.
+//
+// Prefers Mesa's surfaceless platform, which needs neither a display server nor a GPU (llvmpipe renders on the
+// CPU), and falls back to the default EGL display. The context is made current without a surface, so everything
+// has to be drawn into an OffscreenTarget. Context versions are tried newest first, like the window's.
+class HeadlessContext {
+public:
+    HeadlessContext()
+    {
+        const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        {
+            auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay)
+                display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        {
+            cout << "ERROR::HEADLESS:: no EGL display, error 0x" << hex << eglGetError() << dec << endl;
+            display = EGL_NO_DISPLAY;
+            return;
+        }
+        const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            cout << "ERROR::HEADLESS:: EGL display can't make a context current without a surface" << endl;
+            return;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            cout << "ERROR::HEADLESS:: EGL display has no desktop OpenGL" << endl;
+            return;
+        }
+
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            cout << "ERROR::HEADLESS:: no EGL config supports OpenGL" << endl;
+            return;
+        }
+
+        const int contextVersions[][2] = {{4, 6}, {4, 5}, {4, 3}, {3, 3}};
+        for (const auto &version : contextVersions)
+        {
+            const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+            if (context != EGL_NO_CONTEXT)
+                break;
+        }
+        if (context == EGL_NO_CONTEXT)
+        {
+            cout << "ERROR::HEADLESS:: couldn't create an OpenGL 3.3 or later context" << endl;
+            return;
+        }
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            cout << "ERROR::HEADLESS:: couldn't make the context current, error 0x" << hex << eglGetError() << dec << endl;
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+    }
+
+    ~HeadlessContext()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    bool IsValid() const { return context != EGL_NO_CONTEXT; }
+
+    // for gladLoadGLLoader, EGL 1.5 and Mesa hand out core functions as well as extensions
+    static void *GetProcAddress(const char *name) { return (void*)eglGetProcAddress(name); }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+// A framebuffer object standing in for the window's default framebuffer: an RGBA8 color and a depth-stencil
+// renderbuffer at a fixed size.
+class OffscreenTarget {
+public:
+    OffscreenTarget(int width, int height) : width(width), height(height)
+    {
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::HEADLESS:: offscreen framebuffer incomplete, status 0x" << hex << status << dec << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    // draws and reads go to the target from here on
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    GLuint Framebuffer() const { return framebuffer; }
+
+private:
+    int width, height;
+    GLuint framebuffer = 0, color = 0, depth = 0;
+};
+
+#endif
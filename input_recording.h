@@ -0,0 +1,89 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// the keys processInput reacts to, one bit each in an InputFrame
+enum InputKey : unsigned int {
+    INPUT_FORWARD     = 1 << 0,
+    INPUT_BACKWARD    = 1 << 1,
+    INPUT_LEFT        = 1 << 2,
+    INPUT_RIGHT       = 1 << 3,
+    INPUT_DIRECTIONAL = 1 << 4, // dims the lights while held, see Switches
+    INPUT_POINT       = 1 << 5,
+    INPUT_SPOT        = 1 << 6,
+    INPUT_AMBIENT     = 1 << 7, // turns the lighting terms off while held, see LightingModelCtl
+    INPUT_DIFFUSE     = 1 << 8,
+    INPUT_SPECULAR    = 1 << 9
+};
+
+// what one frame's input amounted to: the keys held when it was sampled, the mouse movement since the last
+// frame, in the same units the mouse and scroll callbacks get, and the seconds the held keys move the camera for
+struct InputFrame {
+    unsigned int keys = 0;
+    float mouseX = 0.0f, mouseY = 0.0f;
+    float scroll = 0.0f;
+    float deltaTime = 0.0f;
+
+    bool Held(InputKey key) const { return (keys & key) != 0; }
+};
+
+// Input captured frame by frame, to be played back so a benchmark flies the same route on every run. The camera
+// moves by each frame's recorded deltaTime, which is the wall clock's while recording, while the benchmark steps
+// everything else at its fixed timestep.
+//
+// Saved as text: a header line, then "keys mouseX mouseY scroll deltaTime" for every frame.
+class InputRecording {
+public:
+    void Add(const InputFrame &frame) { frames.push_back(frame); }
+    size_t Size() const { return frames.size(); }
+
+    // frames past the end of the recording have no input
+    InputFrame Frame(size_t index) const { return index < frames.size() ? frames[index] : InputFrame(); }
+
+    bool Save(const string &path) const
+    {
+        ofstream file(path);
+        if (!file)
+        {
+            cout << "ERROR::INPUT_RECORDING:: can't write " << path << endl;
+            return false;
+        }
+        file << HEADER << "\n";
+        for (const InputFrame &frame : frames)
+            file << frame.keys << " " << frame.mouseX << " " << frame.mouseY << " " << frame.scroll << " " << frame.deltaTime << "\n";
+        return true;
+    }
+
+    bool Load(const string &path)
+    {
+        ifstream file(path);
+        string header;
+        if (!file || !getline(file, header) || header != HEADER)
+        {
+            cout << "ERROR::INPUT_RECORDING:: " << path << " isn't an input recording" << endl;
+            return false;
+        }
+        frames.clear();
+        InputFrame frame;
+        while (file >> frame.keys >> frame.mouseX >> frame.mouseY >> frame.scroll >> frame.deltaTime)
+            frames.push_back(frame);
+        if (!file.eof())
+        {
+            cout << "ERROR::INPUT_RECORDING:: bad frame " << frames.size() << " in " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char *HEADER = "learnOpenGL input 2";
+    vector<InputFrame> frames;
+};
+
+#endif
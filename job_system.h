@@ -0,0 +1,560 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "profiler.h"
+
+using namespace std;
+
+enum JobAffinity {
+    JOB_ANY_THREAD,
+    JOB_MAIN_THREAD // for work that touches GL, only run by the thread that created the JobSystem
+};
+
+class JobSystem;
+
+// A unit of work. Its dependency count starts at one for the submission itself plus one per AddDependency, and
+// it's queued when the count reaches zero. Jobs are reference counted by their handles and by the scheduler
+// while they're pending, so a handle may be dropped right after Submit. The work is stored in the job itself and
+// the job comes from its JobSystem's pool, so submitting doesn't allocate.
+class Job {
+public:
+    // bytes of captures a job's work can hold, ParallelFor's ranges take 32
+    static constexpr size_t WORK_SIZE = 64;
+
+    bool IsFinished() const { return finished.load(memory_order_acquire); }
+
+private:
+    friend class JobSystem;
+    friend class JobHandle;
+
+    alignas(max_align_t) unsigned char work[WORK_SIZE];
+    void (*run)(void *work) = nullptr;
+    void (*destroy)(void *work) = nullptr; // null once the work is gone, run or not
+    JobSystem *system = nullptr;
+    JobAffinity affinity = JOB_ANY_THREAD;
+    atomic<int> dependencies{1};
+    atomic<int> references{1};
+    atomic<bool> finished{false};
+    mutex dependentsMutex; // guards dependents against the job finishing while one is added
+    vector<Job*> dependents;
+
+    void Retain() { references.fetch_add(1, memory_order_relaxed); }
+    // the last reference hands the job back to the pool
+    inline void Release();
+
+    void destroyWork()
+    {
+        if (destroy)
+            destroy(work);
+        run = nullptr;
+        destroy = nullptr;
+    }
+};
+
+class JobHandle {
+public:
+    JobHandle() = default;
+    JobHandle(const JobHandle &other) : job(other.job) { if (job) job->Retain(); }
+    JobHandle(JobHandle &&other) noexcept : job(other.job) { other.job = nullptr; }
+    JobHandle &operator=(JobHandle other) { swap(job, other.job); return *this; }
+    ~JobHandle() { if (job) job->Release(); }
+
+    bool IsValid() const { return job != nullptr; }
+    bool IsFinished() const { return !job || job->IsFinished(); }
+
+private:
+    friend class JobSystem;
+    explicit JobHandle(Job *job) : job(job) {}
+    Job *job = nullptr;
+};
+
+// scheduler counters, reset by ResetStats
+struct JobStats {
+    uint64_t executed = 0;
+    uint64_t stolen = 0;
+    uint64_t overflowed = 0; // pushes that didn't fit a worker's deque and went to the shared queue
+};
+
+// Work-stealing job scheduler with a fixed number of threads.
+//
+// The thread that creates the JobSystem takes part as worker 0, the others are started once and live until the
+// JobSystem is destroyed. Each worker has a Chase-Lev deque: it pushes and pops its own jobs at the bottom, LIFO,
+// which keeps recently touched data in its cache, while idle workers steal from the top of a random victim's
+// deque. Jobs submitted from threads that aren't workers, and pushes to a full deque, go to a shared queue.
+// JOB_MAIN_THREAD jobs wait in their own queue until the main thread runs them from Wait() or
+// RunMainThreadJobs(). Waiting never blocks a worker: it runs other jobs until the awaited one is done.
+//
+// Jobs are allocated in blocks that live as long as the JobSystem. Each worker keeps its own list of free jobs and
+// trades them with a shared list in batches, threads that aren't workers use the shared list directly. Handles
+// must be dropped before the JobSystem is destroyed. Jobs that haven't run by then never do, their work is
+// destroyed with them.
+class JobSystem {
+public:
+    // threadCount includes the main thread, 0 picks one per hardware thread
+    explicit JobSystem(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = max(1u, thread::hardware_concurrency());
+        queues.reserve(threadCount);
+        for (unsigned int i = 0; i < threadCount; i++)
+            queues.emplace_back(new WorkQueue());
+        counters.reset(new WorkerCounters[threadCount]);
+        pools.reset(new WorkerPool[threadCount]);
+
+        current = this;
+        workerIndex = 0;
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread &worker : workers)
+            worker.join();
+        // whatever is still queued or waiting on a dependency, the blocks take the jobs themselves with them
+        for (const unique_ptr<Job[]> &block : blocks)
+            for (size_t i = 0; i < JOB_BLOCK_SIZE; i++)
+                block[i].destroyWork();
+        if (current == this)
+            current = nullptr;
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // creates a job that doesn't run until it's submitted, so dependencies can be added first. work is any
+    // callable of up to Job::WORK_SIZE bytes, it's moved into the job.
+    template <typename Work>
+    JobHandle Create(Work &&work, JobAffinity affinity = JOB_ANY_THREAD)
+    {
+        using Stored = decay_t<Work>;
+        static_assert(sizeof(Stored) <= Job::WORK_SIZE && alignof(Stored) <= alignof(max_align_t),
+                      "a job's work has to fit in Job::WORK_SIZE, capture big things by reference");
+        Job *job = allocate();
+        new (job->work) Stored(std::forward<Work>(work));
+        job->run = [](void *stored) { (*static_cast<Stored*>(stored))(); };
+        job->destroy = [](void *stored) { static_cast<Stored*>(stored)->~Stored(); };
+        job->affinity = affinity;
+        return JobHandle(job);
+    }
+
+    // job won't start before dependency has finished. Both must come from Create(), job must not be submitted yet.
+    void AddDependency(const JobHandle &job, const JobHandle &dependency)
+    {
+        lock_guard<mutex> lock(dependency.job->dependentsMutex);
+        if (dependency.job->IsFinished())
+            return;
+        job.job->dependencies.fetch_add(1, memory_order_relaxed);
+        job.job->Retain();
+        dependency.job->dependents.push_back(job.job);
+    }
+
+    // hands the job to the scheduler, it's queued as soon as all its dependencies have finished
+    void Submit(const JobHandle &job)
+    {
+        job.job->Retain();
+        release(job.job);
+    }
+
+    template <typename Work>
+    JobHandle Run(Work &&work, JobAffinity affinity = JOB_ANY_THREAD)
+    {
+        JobHandle job = Create(std::forward<Work>(work), affinity);
+        Submit(job);
+        return job;
+    }
+
+    // runs other jobs until this one has finished
+    void Wait(const JobHandle &job)
+    {
+        PROFILE_ZONE("JobSystem::Wait");
+        helpUntil([&]() { return job.IsFinished(); });
+    }
+
+    // calls body(begin, end) over [0, count) in ranges of at most grain items and returns when all are done.
+    // The calling thread runs the first range itself.
+    void ParallelFor(size_t count, size_t grain, const function<void(size_t begin, size_t end)> &body)
+    {
+        PROFILE_ZONE("JobSystem::ParallelFor");
+        if (count == 0)
+            return;
+        grain = max<size_t>(1, grain);
+        size_t rangeCount = (count + grain - 1) / grain;
+        if (rangeCount == 1 || queues.size() == 1)
+        {
+            body(0, count);
+            return;
+        }
+
+        atomic<size_t> remaining(rangeCount - 1);
+        for (size_t range = 1; range < rangeCount; range++)
+        {
+            size_t begin = range * grain, end = min(count, begin + grain);
+            Run([&body, &remaining, begin, end]() {
+                body(begin, end);
+                remaining.fetch_sub(1, memory_order_release);
+            });
+        }
+        body(0, min(count, grain));
+        helpUntil([&]() { return remaining.load(memory_order_acquire) == 0; });
+    }
+
+    // runs the JOB_MAIN_THREAD jobs queued so far, call from the main thread once per frame
+    void RunMainThreadJobs()
+    {
+        while (Job *job = popMainThreadJob())
+            execute(job, 0);
+    }
+
+    unsigned int ThreadCount() const { return static_cast<unsigned int>(queues.size()); }
+
+    // worker index of the calling thread, 0 for the main thread and -1 for threads the system doesn't own
+    static int CurrentWorker() { return workerIndex; }
+
+    JobStats Stats() const
+    {
+        JobStats stats;
+        for (unsigned int i = 0; i < queues.size(); i++)
+        {
+            stats.executed += counters[i].executed.load(memory_order_relaxed);
+            stats.stolen += counters[i].stolen.load(memory_order_relaxed);
+        }
+        stats.overflowed = overflowed.load(memory_order_relaxed);
+        return stats;
+    }
+
+    void ResetStats()
+    {
+        for (unsigned int i = 0; i < queues.size(); i++)
+        {
+            counters[i].executed.store(0, memory_order_relaxed);
+            counters[i].stolen.store(0, memory_order_relaxed);
+        }
+        overflowed.store(0, memory_order_relaxed);
+    }
+
+private:
+    friend class Job;
+
+    // Chase-Lev deque of fixed capacity (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory
+    // Models"). Push and Pop are only called by the owning worker, Steal by anyone.
+    struct WorkQueue {
+        static constexpr int64_t CAPACITY = 4096;
+        static constexpr int64_t MASK = CAPACITY - 1;
+
+        alignas(64) atomic<int64_t> top{0};
+        alignas(64) atomic<int64_t> bottom{0};
+        atomic<Job*> buffer[CAPACITY];
+
+        bool Push(Job *job)
+        {
+            int64_t b = bottom.load(memory_order_relaxed);
+            int64_t t = top.load(memory_order_acquire);
+            if (b - t >= CAPACITY)
+                return false;
+            buffer[b & MASK].store(job, memory_order_relaxed);
+            bottom.store(b + 1, memory_order_release);
+            return true;
+        }
+
+        Job *Pop()
+        {
+            int64_t b = bottom.load(memory_order_relaxed) - 1;
+            bottom.store(b, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t t = top.load(memory_order_relaxed);
+            if (t > b)
+            {
+                bottom.store(b + 1, memory_order_relaxed);
+                return nullptr;
+            }
+            Job *job = buffer[b & MASK].load(memory_order_relaxed);
+            if (t == b)
+            {
+                // last job, race the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                    job = nullptr;
+                bottom.store(b + 1, memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job *Steal()
+        {
+            int64_t t = top.load(memory_order_acquire);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t b = bottom.load(memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            Job *job = buffer[t & MASK].load(memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                return nullptr;
+            return job;
+        }
+    };
+
+    struct alignas(64) WorkerCounters {
+        atomic<uint64_t> executed{0};
+        atomic<uint64_t> stolen{0};
+    };
+
+    // free jobs only its worker touches
+    struct alignas(64) WorkerPool {
+        vector<Job*> free;
+    };
+
+    static constexpr size_t JOB_BLOCK_SIZE = 256;
+    static constexpr size_t JOB_BATCH = 32; // free jobs moved between a worker and the shared list at once
+
+    vector<unique_ptr<WorkQueue>> queues;
+    unique_ptr<WorkerCounters[]> counters;
+    unique_ptr<WorkerPool[]> pools;
+    vector<thread> workers;
+
+    mutex poolMutex;
+    vector<unique_ptr<Job[]>> blocks;
+    vector<Job*> freeJobs;
+
+    mutex sharedMutex;
+    deque<Job*> sharedJobs;
+    deque<Job*> mainThreadJobs;
+    atomic<uint64_t> overflowed{0};
+
+    mutex sleepMutex;
+    condition_variable wake;
+    atomic<int> sleepers{0};
+    bool stopping = false;
+
+    static inline thread_local JobSystem *current = nullptr;
+    static inline thread_local int workerIndex = -1;
+
+    Job *allocate()
+    {
+        Job *job;
+        if (current == this)
+        {
+            vector<Job*> &free = pools[workerIndex].free;
+            if (free.empty())
+            {
+                lock_guard<mutex> lock(poolMutex);
+                while (freeJobs.size() < JOB_BATCH)
+                    grow();
+                free.insert(free.end(), freeJobs.end() - JOB_BATCH, freeJobs.end());
+                freeJobs.resize(freeJobs.size() - JOB_BATCH);
+            }
+            job = free.back();
+            free.pop_back();
+        }
+        else
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if (freeJobs.empty())
+                grow();
+            job = freeJobs.back();
+            freeJobs.pop_back();
+        }
+        job->dependencies.store(1, memory_order_relaxed);
+        job->references.store(1, memory_order_relaxed);
+        job->finished.store(false, memory_order_relaxed);
+        job->dependents.clear();
+        return job;
+    }
+
+    // poolMutex held
+    void grow()
+    {
+        blocks.emplace_back(new Job[JOB_BLOCK_SIZE]);
+        for (size_t i = 0; i < JOB_BLOCK_SIZE; i++)
+        {
+            blocks.back()[i].system = this;
+            freeJobs.push_back(&blocks.back()[i]);
+        }
+    }
+
+    // a job that was never submitted still has its work
+    void recycle(Job *job)
+    {
+        job->destroyWork();
+        if (current == this)
+        {
+            vector<Job*> &free = pools[workerIndex].free;
+            free.push_back(job);
+            if (free.size() >= 2 * JOB_BATCH)
+            {
+                lock_guard<mutex> lock(poolMutex);
+                freeJobs.insert(freeJobs.end(), free.end() - JOB_BATCH, free.end());
+                free.resize(free.size() - JOB_BATCH);
+            }
+            return;
+        }
+        lock_guard<mutex> lock(poolMutex);
+        freeJobs.push_back(job);
+    }
+
+    // drops one dependency, queues the job when it was the last
+    void release(Job *job)
+    {
+        if (job->dependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+            enqueue(job);
+        else
+            job->Release();
+    }
+
+    // the scheduler's reference to the job travels with it through the queues and is dropped in execute()
+    void enqueue(Job *job)
+    {
+        if (job->affinity == JOB_MAIN_THREAD)
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            mainThreadJobs.push_back(job);
+            return;
+        }
+        if (current != this || !queues[workerIndex]->Push(job))
+        {
+            if (current == this)
+                overflowed.fetch_add(1, memory_order_relaxed);
+            lock_guard<mutex> lock(sharedMutex);
+            sharedJobs.push_back(job);
+        }
+        if (sleepers.load(memory_order_relaxed) > 0)
+            wake.notify_one();
+    }
+
+    void execute(Job *job, int worker)
+    {
+        {
+            PROFILE_ZONE("job");
+            job->run(job->work);
+        }
+        job->destroyWork();
+        counters[worker].executed.fetch_add(1, memory_order_relaxed);
+
+        vector<Job*> ready;
+        {
+            lock_guard<mutex> lock(job->dependentsMutex);
+            job->finished.store(true, memory_order_release);
+            ready.swap(job->dependents);
+        }
+        for (Job *dependent : ready)
+            release(dependent);
+        job->Release();
+    }
+
+    Job *popMainThreadJob()
+    {
+        lock_guard<mutex> lock(sharedMutex);
+        if (mainThreadJobs.empty())
+            return nullptr;
+        Job *job = mainThreadJobs.front();
+        mainThreadJobs.pop_front();
+        return job;
+    }
+
+    // own deque first, then the shared queue, then a steal starting at a pseudo-random victim
+    Job *findJob(int worker, uint32_t &seed)
+    {
+        if (Job *job = queues[worker]->Pop())
+            return job;
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            if (!sharedJobs.empty())
+            {
+                Job *job = sharedJobs.front();
+                sharedJobs.pop_front();
+                return job;
+            }
+        }
+        unsigned int count = static_cast<unsigned int>(queues.size());
+        seed = seed * 1664525u + 1013904223u;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            unsigned int victim = (seed + i) % count;
+            if (victim == static_cast<unsigned int>(worker))
+                continue;
+            if (Job *job = queues[victim]->Steal())
+            {
+                counters[worker].stolen.fetch_add(1, memory_order_relaxed);
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    template <typename Done>
+    void helpUntil(Done done)
+    {
+        int worker = current == this ? workerIndex : -1;
+        uint32_t seed = static_cast<uint32_t>(worker + 1) * 2654435761u;
+        while (!done())
+        {
+            Job *job = nullptr;
+            if (worker == 0)
+                job = popMainThreadJob();
+            if (!job && worker >= 0)
+                job = findJob(worker, seed);
+            if (job)
+                execute(job, worker);
+            else
+                this_thread::yield();
+        }
+    }
+
+    void workerLoop(int worker)
+    {
+        current = this;
+        workerIndex = worker;
+        Profiler::SetThreadName("worker " + to_string(worker));
+        uint32_t seed = static_cast<uint32_t>(worker + 1) * 2654435761u;
+        int idleSpins = 0;
+        while (true)
+        {
+            if (Job *job = findJob(worker, seed))
+            {
+                execute(job, worker);
+                idleSpins = 0;
+                continue;
+            }
+            // spin briefly before sleeping, frame work tends to arrive in bursts
+            if (++idleSpins < 64)
+            {
+                this_thread::yield();
+                continue;
+            }
+            unique_lock<mutex> lock(sleepMutex);
+            if (stopping)
+                return;
+            sleepers.fetch_add(1, memory_order_relaxed);
+            // the timeout covers a push that raced the sleepers check, steals aren't announced at all
+            wake.wait_for(lock, chrono::microseconds(500));
+            sleepers.fetch_sub(1, memory_order_relaxed);
+            idleSpins = 0;
+        }
+    }
+};
+
+inline void Job::Release()
+{
+    if (references.fetch_sub(1, memory_order_acq_rel) == 1)
+        system->recycle(this);
+}
+
+#endif
@@ -9,32 +9,125 @@
 
 #include "shader.h"
 #include "camera.h"
+#include "benchmark.h"
+#include "bindings.h"
+#include "frame_pacer.h"
+#include "frame_timings.h"
+#include "frustum.h"
+#include "gl_interceptor.h"
+#include "gpu_culling.h"
+#include "flight_recorder.h"
+#include "gpu_profiler.h"
+#include "input_recording.h"
+#ifdef LEARNOPENGL_HEADLESS
+#include "headless.h"
+#endif
+#include "job_system.h"
+#include "material.h"
+#include "metrics.h"
 #include "model.h"
+#include "occlusion.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "stress_scene.h"
 
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 using namespace std;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void processInput(GLFWwindow *window, InputRecording *recording);
+void applyInput(const InputFrame &input, bool applyMouse);
 void updateSpotLight(Shader shader);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+// command line, e.g. learnOpenGL --headless --width 1920 --height 1080 --frames 600
+// or learnOpenGL --headless --benchmark --camera-path flythrough.txt --report flythrough.json
+// or learnOpenGL --headless --benchmark --instances 10000 --layout clustered --point-lights 64 --gpu-driven
+// or learnOpenGL --profile trace.json
+// or learnOpenGL --headless --gl-stats
+// or learnOpenGL --headless --capture slow.glcapture --capture-frames 10, then learnOpenGL_replay slow.glcapture
+// or learnOpenGL --metrics metrics.jsonl --metrics-prometheus /var/lib/node_exporter/learnopengl.prom
+// or learnOpenGL --flight-recorder 33.3, a trace of every frame over 33.3ms as slow_frame_1.json and on
+// or learnOpenGL --fps-cap 60 --max-frames-in-flight 1
+struct LaunchOptions {
+    bool headless = false;   // no window: render into an offscreen framebuffer and exit with frame timings
+    int width = SCR_WIDTH;
+    int height = SCR_HEIGHT;
+    unsigned int frames = 1000; // how many frames a headless run renders, or a benchmark measures
+    bool benchmark = false;     // fixed timestep, scripted camera, a JSON report at the end
+    BenchmarkSettings benchmarkSettings;
+    string recordInput;         // saves the session's input for a benchmark to replay
+    StressSceneSettings scene;  // generated instances and lights instead of the single model
+    bool gpuDriven = false;     // start on the GPU-driven path
+    bool orbitSet = false;      // the benchmark orbit was given, otherwise it's fitted to the scene
+    string profile;             // profile from the start, the trace is written here on exit
+    bool glStats = false;       // count and time GL calls from the start
+    string capture;             // record every GL call of the loading and the first frames here
+    unsigned int captureFrames = 10;
+    string metricsJson;         // frame metrics appended here as a JSON line every metricsInterval seconds
+    string metricsPrometheus;   // and written here as a Prometheus text file
+    double metricsInterval = 10.0;
+    double frameBudget = 0.0;   // milliseconds, the flight recorder writes a trace of slower frames. 0 for off.
+    double flightRecorderSeconds = 5.0; // of frames before a slow one in its trace
+    unsigned int maxFramesInFlight = 2; // frames the CPU may queue ahead of the GPU
+    double fpsCap = 0.0;        // frames per second the pacer spaces frames out to, 0 leaves it to vsync or the GPU
+};
+bool parseOptions(int argc, char **argv, LaunchOptions &options);
+GLFWwindow *createWindow(const LaunchOptions &options);
+
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+// mouse movement since input was last sampled, see processInput. Off while a benchmark drives the camera.
+InputFrame pendingInput;
+bool liveInput = true;
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+float lastReport = 0.0f;
+
+// rendering path, G toggles between CPU culling + render queue and GPU culling + indirect draws
+bool gpuDriven = false;
+
+// frame pacing, the frames in flight and the cap come from the command line. V toggles vsync and F toggles
+// sampling input as late as the cap allows, which only does something with --fps-cap.
+bool vsync = true;
+bool lateInputSampling = false;
+
+// late latching: culling uses a frustum this much wider than the view, and the camera is sampled again right
+// before the draws are submitted. C toggles it.
+const float LATE_LATCH_FOV_MARGIN = 5.0f;
+bool lateLatching = true;
+
+// profiling: T starts recording zones and stops again writing a Chrome trace here, open it in ui.perfetto.dev.
+// Y prints the GPU time of each pass, averaged over the last frames. B counts and times every GL call, reported
+// once a second. With --flight-recorder the profiler never stops, T writes what it holds.
+string profilePath = "profile.json";
+bool printGpuPasses = false;
+unique_ptr<FlightRecorder> flightRecorder;
+
+// per-frame constants, std140 layout of the Frame block in the material-arrays and gpu-culling vertex shaders
+struct FrameConstants {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 cameraPosition;
+    glm::vec4 cameraDirection;
+};
 
 glm::vec3 pointLightPositions[] = {
         glm::vec3( 0.7f,  0.2f,  2.0f),
@@ -152,43 +245,76 @@ void configureDirLight(Shader shader) {
     shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    LaunchOptions options;
+    if (!parseOptions(argc, argv, options))
+        return -1;
+    Profiler::SetThreadName("main");
+    if (!options.profile.empty())
+    {
+        profilePath = options.profile;
+        Profiler::SetEnabled(true);
+    }
+    if (options.frameBudget > 0.0)
+        flightRecorder = make_unique<FlightRecorder>(options.frameBudget, options.flightRecorderSeconds);
+    if (!options.metricsJson.empty() || !options.metricsPrometheus.empty())
+        if (!Metrics::SetExport(options.metricsJson, options.metricsPrometheus, options.metricsInterval))
+            return -1;
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    // a window, or with --headless an EGL context with no display at all and an offscreen framebuffer to draw into
+    // ----------------------------------------------------------------------------------------------------------
+    GLFWwindow* window = nullptr;
+#ifdef LEARNOPENGL_HEADLESS
+    unique_ptr<HeadlessContext> headlessContext;
+    if (options.headless)
+    {
+        headlessContext.reset(new HeadlessContext());
+        if (!headlessContext->IsValid())
+        {
+            std::cout << "Failed to create headless context" << std::endl;
+            return -1;
+        }
+    }
+    else
 #endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == nullptr)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        window = createWindow(options);
+        if (window == nullptr)
+            return -1;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+#ifdef LEARNOPENGL_HEADLESS
+    GLADloadproc loader = options.headless ? (GLADloadproc)HeadlessContext::GetProcAddress : (GLADloadproc)glfwGetProcAddress;
+#else
+    GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+#endif
+    if (!gladLoadGLLoader(loader))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    // wraps the pointers glad just loaded. A capture starts before anything is created, the replay needs it all.
+    GLInterceptor::SetEnabled(options.glStats);
+    if (!options.capture.empty())
+    {
+        int captureWidth = options.width, captureHeight = options.height;
+        if (window)
+            glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+        GLInterceptor::StartCapture(options.capture, options.captureFrames, captureWidth, captureHeight);
+    }
+
+#ifdef LEARNOPENGL_HEADLESS
+    unique_ptr<OffscreenTarget> offscreen;
+    if (options.headless)
+    {
+        offscreen.reset(new OffscreenTarget(options.width, options.height));
+        std::cout << "headless: " << glGetString(GL_RENDERER) << ", OpenGL " << glGetString(GL_VERSION) << ", "
+                  << options.width << "x" << options.height << ", " << options.frames << " frames" << std::endl;
+    }
+#endif
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
@@ -197,14 +323,41 @@ int main()
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
+    // worker threads for frame and load work, this thread is worker 0 and the only one that runs GL jobs
+    // -------------------------------------------------------------------------------------------------
+    JobSystem jobs;
+
+    // textures are packed into arrays shared by every mesh when the context can read materials from an SSBO
+    bool useMaterialArrays = GLAD_GL_VERSION_4_3;
+    unique_ptr<MaterialLibrary> materials(new MaterialLibrary());
+
     // build and compile shaders
     // -------------------------
-    Shader modelShader("/home/tjweldon/code/cpp/learnOpenGL/shaders/multiple-lights/vertex.glsl", "/home/tjweldon/code/cpp/learnOpenGL/shaders/multiple-lights/fragment.glsl");
+    Shader modelShader = useMaterialArrays
+            ? Shader("/home/tjweldon/code/cpp/learnOpenGL/shaders/material-arrays/vertex.glsl", "/home/tjweldon/code/cpp/learnOpenGL/shaders/material-arrays/fragment.glsl")
+            : Shader("/home/tjweldon/code/cpp/learnOpenGL/shaders/multiple-lights/vertex.glsl", "/home/tjweldon/code/cpp/learnOpenGL/shaders/multiple-lights/fragment.glsl");
     modelShader.use();
 
     // load models
     // -----------
-    Model ourModel("/home/tjweldon/code/cpp/learnOpenGL/assets/backpack/backpack.obj");
+    // the backpack is static, so sub-meshes sharing a material are merged into a single mesh
+    Model ourModel("/home/tjweldon/code/cpp/learnOpenGL/assets/backpack/backpack.obj", false, useMaterialArrays ? materials.get() : nullptr, true);
+    // the model stays where it was imported, world matrices are only recomputed when a node moves
+    ourModel.Update();
+    if (useMaterialArrays)
+        materials->Build();
+
+    // a generated scene of many copies of the model and many lights, for benchmarks that show how things scale
+    unique_ptr<StressScene> stressScene;
+    if (!options.scene.IsEmpty())
+    {
+        stressScene.reset(new StressScene(ourModel, options.scene, &jobs));
+        if (stressScene->LightCount() > 0 && !useMaterialArrays)
+            std::cout << "ERROR::STRESS_SCENE:: generated lights need the material-arrays shader (OpenGL 4.3), they won't show" << std::endl;
+        std::cout << "stress scene: " << stressScene->InstanceCount() << " instances, " << stressScene->LightCount()
+                  << " lights" << std::endl;
+    }
+    bool drawStressScene = stressScene && stressScene->InstanceCount() > 0;
 
     configureDirLight(modelShader);
     configureSpotLight(modelShader);
@@ -212,105 +365,657 @@ int main()
     switches.sync(modelShader);
     ads.sync(modelShader);
 
+    // draws are queued each frame and submitted sorted by state and depth
+    RenderQueue renderQueue(jobs.ThreadCount());
+    // meshes outside the view frustum never reach the queue
+    FrustumCuller culler;
+    // nor do those hidden behind the model's largest meshes, which are rasterized on the CPU as occluders
+    vector<OccluderMesh> occluders = OccluderMesh::SelectFrom(ourModel.meshes);
+    OcclusionCuller occlusion(256, 128, &jobs);
+
+    // per-frame and per-draw data is written straight into a persistently mapped ring and bound by range, only
+    // the shaders that read from the material arrays declare the Frame and Draw blocks. 4MB a frame holds the
+    // constants of some 16k draws at the usual 256 byte offset alignment, a stress scene gets room for all of its
+    // draws.
+    unique_ptr<RingBuffer> frameBuffer;
+    if (useMaterialArrays)
+    {
+        GLsizeiptr ringSize = 4 * 1024 * 1024;
+        if (drawStressScene)
+            ringSize = max(ringSize, static_cast<GLsizeiptr>(stressScene->MaxDraws() * 256 + 64 * 1024));
+        frameBuffer.reset(new RingBuffer(GL_UNIFORM_BUFFER, ringSize));
+        renderQueue.UseConstantsBuffer(frameBuffer.get(), DRAW_UNIFORM_BINDING);
+    }
+
+    // GPU-driven path: every mesh becomes an instance culled and compacted into indirect draws by compute shaders
+    unique_ptr<GpuCuller> gpuCuller;
+    unique_ptr<Shader> gpuShader;
+    if (useMaterialArrays)
+    {
+        gpuCuller.reset(new GpuCuller("/home/tjweldon/code/cpp/learnOpenGL/shaders/gpu-culling/cull.comp", "/home/tjweldon/code/cpp/learnOpenGL/shaders/gpu-culling/hiz.comp"));
+        for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+            gpuCuller->AddMesh(ourModel.meshes[i]);
+        if (drawStressScene)
+            stressScene->AddTo(*gpuCuller);
+        else
+            for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+                gpuCuller->AddInstance(i, ourModel.MeshTransform(i));
+        gpuCuller->Upload();
+
+        gpuShader.reset(new Shader("/home/tjweldon/code/cpp/learnOpenGL/shaders/gpu-culling/vertex.glsl", "/home/tjweldon/code/cpp/learnOpenGL/shaders/material-arrays/fragment.glsl"));
+        gpuShader->use();
+        configureDirLight(*gpuShader);
+        configureSpotLight(*gpuShader);
+        configurePointLights(*gpuShader);
+    }
+
+    // keeps the CPU at most --max-frames-in-flight frames ahead of the GPU
+    FramePacer pacer(options.maxFramesInFlight, options.fpsCap, lateInputSampling);
+    // GPU time per pass, on the profiler's trace as well when it's recording
+    GpuProfiler gpuProfiler;
+    bool appliedVsync = !vsync;
+    double lateLatchMilliseconds = 0.0;
+
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // a benchmark steps time and moves the camera itself, a recording captures the live input for one to replay
+    unique_ptr<BenchmarkRunner> benchmark;
+    gpuDriven = options.gpuDriven;
+    if (options.benchmark)
+    {
+        options.benchmarkSettings.frames = options.frames;
+        if (drawStressScene && !options.orbitSet)
+        {
+            options.benchmarkSettings.orbitRadius = stressScene->Radius() * 1.2f;
+            options.benchmarkSettings.orbitHeight = stressScene->Radius() * 0.4f;
+        }
+        benchmark.reset(new BenchmarkRunner(options.benchmarkSettings, options.maxFramesInFlight));
+        if (!benchmark->IsValid())
+            return -1;
+        vsync = false;
+        liveInput = false;
+    }
+    unique_ptr<InputRecording> inputRecording;
+    if (!options.recordInput.empty())
+        inputRecording.reset(new InputRecording());
+
+    // a headless run times every frame, start to finish
+    FrameTimings frameTimings;
+    unsigned int frameCount = 0;
+    float simulationTime = 0.0f;
+    auto runStart = chrono::steady_clock::now();
+    // the loading counts as a frame of its own, a capture keeps it apart from the first frame
+    GLInterceptor::EndFrame();
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (benchmark ? !benchmark->Finished() && !(window && glfwWindowShouldClose(window))
+                     : window ? !glfwWindowShouldClose(window) : frameCount < options.frames)
     {
+        PROFILE_ZONE("frame");
+        auto frameBegin = chrono::steady_clock::now();
+        if (flightRecorder)
+            flightRecorder->BeginFrame();
+        if (window && vsync != appliedVsync)
+        {
+            glfwSwapInterval(vsync ? 1 : 0);
+            appliedVsync = vsync;
+        }
+        pacer.SetLateInputSampling(lateInputSampling);
+        {
+            PROFILE_ZONE("FramePacer::BeginFrame");
+            pacer.BeginFrame();
+        }
+        // poll IO events (keys pressed/released, mouse moved etc.) after the pacer's sleep, so the frame reads the
+        // input of the moment it starts rather than of the last swap
+        if (window)
+            glfwPollEvents();
+        // the frame runs with the toggles as they are now, latchCamera polls events again mid-frame and
+        // key_callback may flip them then
+        const bool frameGpuDriven = gpuDriven && gpuCuller;
+        const bool frameLateLatching = lateLatching;
+        gpuProfiler.BeginFrame();
+        auto frameStart = chrono::steady_clock::now();
+        if (benchmark)
+            benchmark->Collect(pacer.LastFrameStats());
+
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
+        float currentFrame = static_cast<float>(window ? glfwGetTime() : chrono::duration<double>(chrono::steady_clock::now() - runStart).count());
+        deltaTime = benchmark ? benchmark->Timestep() : currentFrame - lastFrame;
         lastFrame = currentFrame;
+        simulationTime += deltaTime;
 
         // input
         // -----
-        processInput(window);
+        {
+            PROFILE_ZONE("input");
+            if (window)
+                processInput(window, inputRecording.get());
+            if (benchmark)
+                benchmark->Drive(camera, [](const InputFrame &input) { applyInput(input, true); });
+        }
+
+        // GL work queued by jobs since last frame
+        {
+            PROFILE_ZONE("JobSystem::RunMainThreadJobs");
+            jobs.RunMainThreadJobs();
+        }
 
         // render
         // ------
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // don't forget to enable shader before setting uniforms
-        modelShader.use();
+#ifdef LEARNOPENGL_HEADLESS
+        if (offscreen)
+            offscreen->Bind();
+#endif
+        {
+            GPU_PROFILE_ZONE(&gpuProfiler, "clear");
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)options.width / (float)options.height, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        modelShader.setMat4("projection", projection);
-        modelShader.setMat4("view", view);
-        updateSpotLight(modelShader);
-        switches.sync(modelShader);
-        ads.sync(modelShader);
+        // a late-latched camera may turn a little further before the draws go out, cull for a wider view
+        glm::mat4 cullProjection = frameLateLatching
+            ? glm::perspective(glm::radians(camera.Zoom + LATE_LATCH_FOV_MARGIN), (float)options.width / (float)options.height, 0.1f, 100.0f)
+            : projection;
+
+        // nodes moved since last frame get new world matrices, the GPU instances follow their meshes
+        if (ourModel.Update() > 0 && gpuCuller && !drawStressScene)
+            for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+                gpuCuller->SetTransform(i, ourModel.MeshTransform(i));
+        if (stressScene)
+            stressScene->Update(simulationTime, gpuCuller.get());
+
+        RingAllocation frameConstants;
+        if (frameBuffer)
+        {
+            frameBuffer->BeginFrame();
+            FrameConstants constants{projection, view, glm::vec4(camera.Position, 1.0f), glm::vec4(camera.Front, 0.0f)};
+            frameConstants = frameBuffer->Write(constants);
+            frameBuffer->BindRange(FRAME_UNIFORM_BINDING, frameConstants);
+        }
+
+        // picks up mouse movement that arrived while the frame was being culled and recorded and rewrites the
+        // camera the draws will read, the shader must be in use when there's no frame ring
+        auto latchCamera = [&](Shader &shader) {
+            if (!frameLateLatching)
+                return;
+            PROFILE_ZONE("latch camera");
+            auto sampled = chrono::steady_clock::now();
+            if (window)
+                glfwPollEvents();
+            view = camera.GetViewMatrix();
+            if (frameBuffer)
+                frameBuffer->Overwrite(frameConstants, FrameConstants{projection, view, glm::vec4(camera.Position, 1.0f), glm::vec4(camera.Front, 0.0f)});
+            else
+                shader.setMat4("view", view);
+            updateSpotLight(shader);
+            lateLatchMilliseconds = chrono::duration<double, milli>(sampled - frameStart).count();
+        };
+
+        if (frameGpuDriven)
+        {
+            {
+                PROFILE_ZONE("GpuCuller::Cull");
+                GPU_PROFILE_ZONE(&gpuProfiler, "GpuCuller::Cull");
+                gpuCuller->Cull(cullProjection, view);
+            }
+
+            {
+                PROFILE_ZONE("uniforms");
+                gpuShader->use();
+                updateSpotLight(*gpuShader);
+                switches.sync(*gpuShader);
+                ads.sync(*gpuShader);
+                materials->Bind(*gpuShader);
+                if (stressScene)
+                    stressScene->BindLights(*gpuShader);
+            }
+            latchCamera(*gpuShader);
+            // the depth the next frame's Hi-Z test reads is drawn with the latched view and the unwidened projection
+            gpuCuller->SetDepthViewProjection(projection * view);
+            PROFILE_ZONE("GpuCuller::Draw");
+            GPU_PROFILE_ZONE(&gpuProfiler, "opaque");
+            gpuCuller->Draw();
+        }
+        else
+        {
+            {
+                PROFILE_ZONE("uniforms");
+                // don't forget to enable shader before setting uniforms
+                modelShader.use();
+
+                // view/projection transformations, the material-arrays shader reads them from the frame ring instead
+                if (!frameBuffer)
+                {
+                    modelShader.setMat4("projection", projection);
+                    modelShader.setMat4("view", view);
+                }
+                updateSpotLight(modelShader);
+                switches.sync(modelShader);
+                ads.sync(modelShader);
+
+                // render the loaded model
+                if (useMaterialArrays)
+                    materials->Bind(modelShader);
+                if (stressScene && useMaterialArrays)
+                    stressScene->BindLights(modelShader);
+            }
+            Frustum frustum = Frustum::FromMatrix(cullProjection * view);
+            if (drawStressScene)
+            {
+                // the instances are culled through the scene's BVH, the model's occluders would only cover one
+                GPU_PROFILE_ZONE(&gpuProfiler, "opaque");
+                GpuScope modelScope(&gpuProfiler, ourModel.profileZone);
+                stressScene->Draw(modelShader, renderQueue, frustum, view);
+                latchCamera(modelShader);
+                renderQueue.Flush();
+            }
+            else
+            {
+                {
+                    PROFILE_ZONE("occluders");
+                    occlusion.BeginFrame(projection * view);
+                    for (const OccluderMesh &occluder : occluders)
+                        occlusion.AddOccluder(occluder, ourModel.MeshTransform(occluder.mesh));
+                    occlusion.Rasterize();
+                }
+                GPU_PROFILE_ZONE(&gpuProfiler, "opaque");
+                GpuScope modelScope(&gpuProfiler, ourModel.profileZone);
+                ourModel.Draw(modelShader, renderQueue, culler, frustum, view, &occlusion, LAYER_OPAQUE, &jobs);
+                latchCamera(modelShader);
+                renderQueue.Flush();
+                culler.EndFrame();
+                occlusion.EndFrame();
+            }
+        }
+        if (frameBuffer)
+            frameBuffer->EndFrame();
+
+        // frame metrics, Mesh counts the draws, triangles, vertices and texture binds it issues itself
+        if (frameGpuDriven)
+        {
+            // how many instances survive is only known on the GPU, the indirect draw counts as one
+            Metrics::DrawCalls.Add();
+            Metrics::TextureBinds.Add(materials->ArrayCount());
+        }
+        else
+        {
+            const RenderQueue::Stats &queueStats = renderQueue.LastFrameStats();
+            Metrics::StateChanges.Add(queueStats.sorted.Total());
+            Metrics::UniformUploads.Add(queueStats.uniformSets);
+            if (useMaterialArrays)
+                Metrics::TextureBinds.Add(materials->ArrayCount());
+            if (drawStressScene)
+                Metrics::ObjectsCulled.Add(stressScene->InstanceCount() - stressScene->LastFrameStats().visibleInstances);
+            else
+                Metrics::ObjectsCulled.Add(culler.LastFrameStats().Culled() + occlusion.LastFrameStats().occluded);
+        }
+        if (frameBuffer)
+            Metrics::BytesUploaded.Add(frameBuffer->LastFrameStats().bytesWritten);
+
+        if (printGpuPasses)
+        {
+            gpuProfiler.Print();
+            printGpuPasses = false;
+        }
 
-        // render the loaded model
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-        modelShader.setMat4("model", model);
-        ourModel.Draw(modelShader);
+        // report how much sorting saved, once a second
+        if (currentFrame - lastReport >= 1.0f)
+        {
+            const RenderQueue::Stats &stats = renderQueue.LastFrameStats();
+            std::cout << "render queue: " << stats.draws << " draws from " << stats.lists << " lists, state changes "
+                      << stats.unsorted.Total() << " unsorted -> " << stats.sorted.Total() << " sorted"
+                      << ", " << stats.rangeBinds << " range binds, " << stats.uniformSets << " uniform sets";
+            if (useMaterialArrays)
+                std::cout << ", " << materials->ArrayCount() << " texture array binds";
+            const CullStats &cullStats = culler.LastFrameStats();
+            std::cout << ", culled " << cullStats.Culled() << "/" << cullStats.tested << " visible " << cullStats.visible
+                      << " in " << cullStats.microseconds << "us";
+            const OcclusionStats &occlusionStats = occlusion.LastFrameStats();
+            std::cout << ", occluded " << occlusionStats.OccludedPercent() << "% in " << occlusionStats.Microseconds() << "us";
+            if (drawStressScene)
+            {
+                const StressSceneStats &sceneStats = stressScene->LastFrameStats();
+                std::cout << ", stress scene " << sceneStats.visibleInstances << "/" << stressScene->InstanceCount()
+                          << " instances visible, culled in " << sceneStats.cullMicroseconds << "us, moved in "
+                          << sceneStats.updateMicroseconds << "us";
+            }
+            if (frameBuffer)
+            {
+                const RingBufferStats &ringStats = frameBuffer->LastFrameStats();
+                std::cout << ", ring " << (frameBuffer->IsPersistent() ? "persistent" : "orphaned") << " "
+                          << ringStats.bytesWritten << " bytes, fence wait " << ringStats.fenceWaitMicroseconds << "us";
+            }
+            const FramePacingStats &pacing = pacer.LastFrameStats();
+            std::cout << ", cpu " << pacing.cpuMilliseconds << "ms, slept " << pacing.sleepMilliseconds
+                      << "ms, fence wait " << pacing.fenceWaitMilliseconds << "ms, latency submit->gpu "
+                      << pacing.submitLatencyMilliseconds << "ms input->gpu " << pacing.inputLatencyMilliseconds << "ms"
+                      << (appliedVsync ? " (vsync)" : "");
+            if (frameLateLatching)
+                std::cout << ", camera latched " << lateLatchMilliseconds << "ms after input";
+            std::cout << std::endl;
+            if (GLInterceptor::IsEnabled())
+                GLInterceptor::Print();
+            lastReport = currentFrame;
+        }
 
+        // the GPU path tests next frame's instances against this frame's depth
+        if (frameGpuDriven)
+        {
+            int framebufferWidth = options.width, framebufferHeight = options.height;
+            if (window)
+                glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            GPU_PROFILE_ZONE(&gpuProfiler, "Hi-Z pyramid");
+            gpuCuller->UpdateDepthPyramid(framebufferWidth, framebufferHeight);
+        }
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // glfw: swap buffers, the events are polled at the start of the next frame
+        // -------------------------------------------------------------------------
+        gpuProfiler.EndFrame();
+        pacer.EndFrame();
+        {
+            PROFILE_ZONE("swap");
+            if (window)
+                glfwSwapBuffers(window);
+            else
+                glFlush();
+        }
+        GLInterceptor::EndFrame();
+        // uploads through glBufferData and the like are only seen while the interceptor is on
+        if (GLInterceptor::IsEnabled())
+            Metrics::BytesUploaded.Add(GLInterceptor::LastFrameStats().bytesUploaded);
+        double frameMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - frameBegin).count();
+        if (benchmark)
+            benchmark->EndFrame(frameMilliseconds);
+        else if (!window)
+            frameTimings.Add(frameMilliseconds);
+        const FramePacingStats &framePacing = pacer.LastFrameStats();
+        Metrics::FrameMilliseconds.Set(frameMilliseconds);
+        Metrics::CpuMilliseconds.Set(framePacing.cpuMilliseconds);
+        Metrics::GpuMilliseconds.Set(framePacing.gpuMilliseconds);
+        Metrics::EndFrame();
+        if (flightRecorder)
+            flightRecorder->EndFrame();
+        frameCount++;
     }
 
+    if (flightRecorder)
+        flightRecorder->Flush();
+    // the flight recorder keeps the profiler on, the whole trace is only written when asked for
+    if (Profiler::IsEnabled() && (!flightRecorder || !options.profile.empty()))
+    {
+        glFinish();
+        // the last frames' GPU scopes are only read back once their slots come round again
+        for (unsigned int i = 0; i < GpuProfiler::FRAME_LATENCY; i++)
+        {
+            gpuProfiler.BeginFrame();
+            gpuProfiler.EndFrame();
+        }
+        gpuProfiler.Print();
+        Profiler::WriteTrace(profilePath);
+    }
+    // fewer frames than asked for were rendered
+    GLInterceptor::StopCapture();
+    if (inputRecording)
+    {
+        inputRecording->Save(options.recordInput);
+        std::cout << "recorded " << inputRecording->Size() << " frames of input to " << options.recordInput << std::endl;
+    }
+    if (benchmark)
+    {
+        glFinish();
+        benchmark->Print();
+        benchmark->WriteReport();
+    }
+
+    if (!window)
+    {
+        // the last frames are only counted as done once the GPU has finished them
+        glFinish();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
+        std::cout << "headless: " << frameCount << " frames in " << seconds << "s, " << frameCount / seconds << " fps" << std::endl;
+        if (!benchmark)
+            frameTimings.Print("frame time");
+        if (GLInterceptor::IsEnabled())
+            GLInterceptor::Print();
+        return 0;
+    }
+
+    // GL objects go while the context they belong to is still there
+    frameBuffer.reset();
+    gpuCuller.reset();
+    materials.reset();
+    stressScene.reset();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
     return 0;
 }
 
+// reads the options LaunchOptions describes, false after printing usage for anything else
+// -----------------------------------------------------------------------------------------------
+bool parseOptions(int argc, char **argv, LaunchOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(argv[i], "--width") == 0 && hasValue)
+            options.width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--height") == 0 && hasValue)
+            options.height = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            options.frames = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            options.benchmark = true;
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            options.benchmarkSettings.warmupFrames = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--timestep") == 0 && hasValue)
+            options.benchmarkSettings.timestep = static_cast<float>(atof(argv[++i]));
+        else if (strcmp(argv[i], "--camera-path") == 0 && hasValue)
+            options.benchmarkSettings.cameraPath = argv[++i];
+        else if (strcmp(argv[i], "--replay-input") == 0 && hasValue)
+            options.benchmarkSettings.inputReplay = argv[++i];
+        else if (strcmp(argv[i], "--report") == 0 && hasValue)
+            options.benchmarkSettings.report = argv[++i];
+        else if (strcmp(argv[i], "--record-input") == 0 && hasValue)
+            options.recordInput = argv[++i];
+        else if (strcmp(argv[i], "--orbit") == 0 && i + 2 < argc)
+        {
+            options.benchmarkSettings.orbitRadius = static_cast<float>(atof(argv[++i]));
+            options.benchmarkSettings.orbitHeight = static_cast<float>(atof(argv[++i]));
+            options.orbitSet = true;
+        }
+        else if (strcmp(argv[i], "--instances") == 0 && hasValue)
+            options.scene.instances = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--layout") == 0 && hasValue)
+        {
+            if (!StressScene::ParseLayout(argv[++i], options.scene.layout))
+            {
+                std::cout << "ERROR::OPTIONS:: layout must be grid, random or clustered, not " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--spacing") == 0 && hasValue)
+            options.scene.spacing = static_cast<float>(atof(argv[++i]));
+        else if (strcmp(argv[i], "--point-lights") == 0 && hasValue)
+            options.scene.pointLights = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--spot-lights") == 0 && hasValue)
+            options.scene.spotLights = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--light-radius") == 0 && hasValue)
+            options.scene.lightRadius = static_cast<float>(atof(argv[++i]));
+        else if (strcmp(argv[i], "--moving") == 0)
+            options.scene.moving = true;
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+            options.scene.seed = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--gpu-driven") == 0)
+            options.gpuDriven = true;
+        else if (strcmp(argv[i], "--profile") == 0 && hasValue)
+            options.profile = argv[++i];
+        else if (strcmp(argv[i], "--gl-stats") == 0)
+            options.glStats = true;
+        else if (strcmp(argv[i], "--capture") == 0 && hasValue)
+            options.capture = argv[++i];
+        else if (strcmp(argv[i], "--capture-frames") == 0 && hasValue)
+            options.captureFrames = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--metrics") == 0 && hasValue)
+            options.metricsJson = argv[++i];
+        else if (strcmp(argv[i], "--metrics-prometheus") == 0 && hasValue)
+            options.metricsPrometheus = argv[++i];
+        else if (strcmp(argv[i], "--metrics-interval") == 0 && hasValue)
+            options.metricsInterval = atof(argv[++i]);
+        else if (strcmp(argv[i], "--flight-recorder") == 0 && hasValue)
+            options.frameBudget = atof(argv[++i]);
+        else if (strcmp(argv[i], "--flight-recorder-seconds") == 0 && hasValue)
+            options.flightRecorderSeconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--max-frames-in-flight") == 0 && hasValue)
+            options.maxFramesInFlight = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--fps-cap") == 0 && hasValue)
+            options.fpsCap = atof(argv[++i]);
+        else
+        {
+            std::cout << "ERROR::OPTIONS:: unknown option or missing value: " << argv[i] << std::endl;
+            std::cout << "usage: " << argv[0] << " [--headless] [--width pixels] [--height pixels] [--frames count]\n"
+                      << "    [--benchmark [--warmup frames] [--timestep seconds] [--camera-path file | --replay-input file]\n"
+                      << "        [--orbit radius height] [--report file]] [--record-input file] [--gpu-driven]\n"
+                      << "    [--instances count [--layout grid|random|clustered] [--spacing distance]] [--point-lights count]\n"
+                      << "    [--spot-lights count] [--light-radius distance] [--moving] [--seed number] [--profile file]\n"
+                      << "    [--gl-stats] [--capture file [--capture-frames count]] [--metrics file] [--metrics-prometheus file]\n"
+                      << "    [--metrics-interval seconds] [--flight-recorder budget-milliseconds [--flight-recorder-seconds seconds]]\n"
+                      << "    [--max-frames-in-flight count] [--fps-cap fps]"
+                      << std::endl;
+            return false;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0)
+    {
+        std::cout << "ERROR::OPTIONS:: width and height must be positive" << std::endl;
+        return false;
+    }
+    if (options.maxFramesInFlight == 0 || options.fpsCap < 0.0)
+    {
+        std::cout << "ERROR::OPTIONS:: at least one frame must be allowed in flight and the cap can't be negative" << std::endl;
+        return false;
+    }
+    if (options.benchmarkSettings.timestep <= 0.0f)
+    {
+        std::cout << "ERROR::OPTIONS:: the timestep must be positive" << std::endl;
+        return false;
+    }
+    if (options.benchmark && options.headless && !options.recordInput.empty())
+    {
+        std::cout << "ERROR::OPTIONS:: there's no input to record in a headless benchmark" << std::endl;
+        return false;
+    }
+#ifndef LEARNOPENGL_HEADLESS
+    if (options.headless)
+    {
+        std::cout << "ERROR::OPTIONS:: built without EGL, --headless isn't available" << std::endl;
+        return false;
+    }
+#endif
+    return true;
+}
+
+// glfw: initialize, configure and open the window, newest context first: material arrays need 4.3, everything
+// else runs on 3.3
+// -------------------------------------------------------------------------------------------------------------
+GLFWwindow *createWindow(const LaunchOptions &options)
+{
+    glfwInit();
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    GLFWwindow* window = nullptr;
+    const int contextVersions[][2] = {{4, 6}, {4, 5}, {4, 3}, {3, 3}};
+    for (const auto &version : contextVersions)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(options.width, options.height, "LearnOpenGL", NULL, NULL);
+        if (window != nullptr)
+            break;
+    }
+    if (window == nullptr)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
+
+    // tell GLFW to capture our mouse
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    return window;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
+void processInput(GLFWwindow *window, InputRecording *recording)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+    if (!liveInput)
+        return;
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
-
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
-        switches.switchDirectional(1.0f);
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
-        switches.switchDirectional(-1.0f);
-
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
-        switches.switchPoint(1.0f);
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-        switches.switchPoint(-1.0f);
-
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
-        switches.switchSpot(1.0f);
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-        switches.switchSpot(-1.0f);
-
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_RELEASE)
-        ads.switchAmbient(100.0f);
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
-        ads.switchAmbient(-100.0f);
-
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE)
-        ads.switchDiffuse(100.0f);
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
-        ads.switchDiffuse(-100.0f);
-
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)
-        ads.switchSpecular(100.0f);
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-        ads.switchSpecular(-100.0f);
+    // the mouse has already turned the camera in mouse_callback, it's only taken along for the recording
+    InputFrame input = pendingInput;
+    pendingInput = InputFrame();
+    const unsigned int keys[][2] = {
+        {GLFW_KEY_W, INPUT_FORWARD}, {GLFW_KEY_S, INPUT_BACKWARD}, {GLFW_KEY_A, INPUT_LEFT}, {GLFW_KEY_D, INPUT_RIGHT},
+        {GLFW_KEY_I, INPUT_DIRECTIONAL}, {GLFW_KEY_O, INPUT_POINT}, {GLFW_KEY_P, INPUT_SPOT},
+        {GLFW_KEY_J, INPUT_AMBIENT}, {GLFW_KEY_K, INPUT_DIFFUSE}, {GLFW_KEY_L, INPUT_SPECULAR}
+    };
+    for (const auto &key : keys)
+        if (glfwGetKey(window, key[0]) == GLFW_PRESS)
+            input.keys |= key[1];
+    input.deltaTime = deltaTime;
+    applyInput(input, false);
+    if (recording)
+        recording->Add(input);
+}
+
+// what a frame's input does, live or replayed. Live mouse movement is applied as it arrives instead.
+// ---------------------------------------------------------------------------------------------------
+void applyInput(const InputFrame &input, bool applyMouse)
+{
+    // by the frame's own timestep, a replay moves as far as the recorded frame did whatever its timestep
+    if (input.Held(INPUT_FORWARD))
+        camera.ProcessKeyboard(FORWARD, input.deltaTime);
+    if (input.Held(INPUT_BACKWARD))
+        camera.ProcessKeyboard(BACKWARD, input.deltaTime);
+    if (input.Held(INPUT_LEFT))
+        camera.ProcessKeyboard(LEFT, input.deltaTime);
+    if (input.Held(INPUT_RIGHT))
+        camera.ProcessKeyboard(RIGHT, input.deltaTime);
+
+    switches.switchDirectional(input.Held(INPUT_DIRECTIONAL) ? -1.0f : 1.0f);
+    switches.switchPoint(input.Held(INPUT_POINT) ? -1.0f : 1.0f);
+    switches.switchSpot(input.Held(INPUT_SPOT) ? -1.0f : 1.0f);
+
+    ads.switchAmbient(input.Held(INPUT_AMBIENT) ? -100.0f : 100.0f);
+    ads.switchDiffuse(input.Held(INPUT_DIFFUSE) ? -100.0f : 100.0f);
+    ads.switchSpecular(input.Held(INPUT_SPECULAR) ? -100.0f : 100.0f);
+
+    if (applyMouse)
+    {
+        camera.ProcessMouseMovement(input.mouseX, input.mouseY);
+        if (input.scroll != 0.0f)
+            camera.ProcessMouseScroll(input.scroll);
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -326,6 +1031,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
+    if (!liveInput)
+        return;
     float xpos = static_cast<float>(xposIn);
     float ypos = static_cast<float>(yposIn);
 
@@ -343,12 +1050,50 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastY = ypos;
 
     camera.ProcessMouseMovement(xoffset, yoffset);
+    pendingInput.mouseX += xoffset;
+    pendingInput.mouseY += yoffset;
+}
+
+// glfw: whenever a key is pressed or released, this callback is called. Used for toggles, held keys are
+// polled in processInput
+// ----------------------------------------------------------------------
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (key == GLFW_KEY_G && action == GLFW_PRESS)
+        gpuDriven = !gpuDriven;
+    if (key == GLFW_KEY_V && action == GLFW_PRESS)
+        vsync = !vsync;
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        lateInputSampling = !lateInputSampling;
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        lateLatching = !lateLatching;
+    if (key == GLFW_KEY_T && action == GLFW_PRESS && flightRecorder)
+        Profiler::WriteTrace(profilePath);
+    else if (key == GLFW_KEY_T && action == GLFW_PRESS)
+    {
+        bool recording = !Profiler::IsEnabled();
+        Profiler::SetEnabled(recording);
+        if (recording)
+            std::cout << "profiler: recording, T again to write the trace" << std::endl;
+        else
+            Profiler::WriteTrace(profilePath);
+    }
+    if (key == GLFW_KEY_Y && action == GLFW_PRESS)
+        printGpuPasses = true;
+    if (key == GLFW_KEY_B && action == GLFW_PRESS)
+    {
+        GLInterceptor::SetEnabled(!GLInterceptor::IsEnabled());
+        std::cout << "gl calls: " << (GLInterceptor::IsEnabled() ? "counting" : "off") << std::endl;
+    }
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    if (!liveInput)
+        return;
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    pendingInput.scroll += static_cast<float>(yoffset);
 }
 
@@ -0,0 +1,231 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include "bindings.h"
+#include "shader.h"
+#include "stb_image.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+// limits shared with shaders/material-arrays/*.glsl
+#define MAX_TEXTURE_ARRAYS 8
+#define MAX_MATERIALS 4096
+
+// the vertex attribute the material-arrays shaders read the material index from
+#define MATERIAL_INDEX_ATTRIBUTE 7
+
+// Where a texture lives once packed: the array it went into and its layer. -1 means "no texture".
+struct TextureSlot {
+    int array = -1;
+    int layer = -1;
+};
+
+// Layout of one entry in the material SSBO (std430), one slot per texture type.
+struct GpuMaterial {
+    TextureSlot diffuse;
+    TextureSlot specular;
+    TextureSlot normal;
+    TextureSlot height;
+};
+
+// Packs textures of the same size and format into GL_TEXTURE_2D_ARRAYs so that meshes with different materials
+// share the same texture bindings. Each material becomes an entry in an SSBO of array/layer indices and a mesh
+// selects its entry through the instanced MATERIAL_INDEX_ATTRIBUTE, fed by the draw's baseInstance. Switching
+// material therefore costs no GL state at all and the whole frame binds one texture per distinct format.
+//
+// Usage: construct after the GL context exists, load models with the library, call Build() once, then Bind()
+// before drawing with the material-arrays shader.
+class MaterialLibrary {
+public:
+    vector<GpuMaterial> materials;
+
+    MaterialLibrary()
+    {
+        // identity table so that the per-instance material attribute reads back the draw's baseInstance
+        vector<unsigned int> identity(MAX_MATERIALS);
+        for (unsigned int i = 0; i < MAX_MATERIALS; i++)
+            identity[i] = i;
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, identity.size() * sizeof(unsigned int), identity.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // needs the context it was created in still current
+    ~MaterialLibrary()
+    {
+        for (TextureArray &array : arrays)
+        {
+            glDeleteTextures(1, &array.id);
+            for (unsigned char *layer : array.pending)
+                stbi_image_free(layer);
+        }
+        glDeleteBuffers(1, &indexBuffer);
+        glDeleteBuffers(1, &materialBuffer);
+    }
+
+    MaterialLibrary(const MaterialLibrary &) = delete;
+    MaterialLibrary &operator=(const MaterialLibrary &) = delete;
+
+    // queues a texture for packing and returns its slot, textures are shared by path
+    TextureSlot AddTexture(const string &path)
+    {
+        auto found = slots.find(path);
+        if (found != slots.end())
+            return found->second;
+
+        TextureSlot slot;
+        if (built)
+        {
+            cout << "ERROR::MATERIAL:: texture added after Build(): " << path << endl;
+            return slot;
+        }
+
+        int width, height, nrComponents;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+        if (!data)
+        {
+            cout << "Texture failed to load at path: " << path << endl;
+            return slots[path] = slot;
+        }
+
+        auto format = make_tuple(width, height, nrComponents);
+        auto array = formats.find(format);
+        if (array == formats.end())
+        {
+            if (arrays.size() == MAX_TEXTURE_ARRAYS)
+            {
+                cout << "ERROR::MATERIAL:: more than " << MAX_TEXTURE_ARRAYS << " texture formats, dropping: " << path << endl;
+                stbi_image_free(data);
+                return slots[path] = slot;
+            }
+            array = formats.emplace(format, static_cast<int>(arrays.size())).first;
+            arrays.push_back(TextureArray{0, width, height, nrComponents, {}});
+        }
+
+        slot.array = array->second;
+        slot.layer = static_cast<int>(arrays[slot.array].pending.size());
+        arrays[slot.array].pending.push_back(data);
+        return slots[path] = slot;
+    }
+
+    // registers a material and returns its index, identical materials share an index
+    unsigned int AddMaterial(const GpuMaterial &material)
+    {
+        for (unsigned int i = 0; i < materials.size(); i++)
+            if (memcmp(&materials[i], &material, sizeof(GpuMaterial)) == 0)
+                return i;
+        if (materials.size() == MAX_MATERIALS)
+        {
+            cout << "ERROR::MATERIAL:: more than " << MAX_MATERIALS << " materials" << endl;
+            return 0;
+        }
+        materials.push_back(material);
+        return static_cast<unsigned int>(materials.size() - 1);
+    }
+
+    // points the mesh VAO's material attribute at the identity table, baseInstance then selects the material
+    void Attach(unsigned int VAO) const
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+        glEnableVertexAttribArray(MATERIAL_INDEX_ATTRIBUTE);
+        glVertexAttribIPointer(MATERIAL_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glVertexAttribDivisor(MATERIAL_INDEX_ATTRIBUTE, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // uploads every queued texture into its array and the material table into the SSBO, frees the CPU copies
+    void Build()
+    {
+        for (TextureArray &array : arrays)
+        {
+            GLenum internalFormat, format;
+            if (array.components == 1)
+                internalFormat = GL_R8, format = GL_RED;
+            else if (array.components == 2)
+                internalFormat = GL_RG8, format = GL_RG;
+            else if (array.components == 3)
+                internalFormat = GL_RGB8, format = GL_RGB;
+            else
+                internalFormat = GL_RGBA8, format = GL_RGBA;
+
+            glGenTextures(1, &array.id);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+            // rows of 1, 2 and 3 component images aren't necessarily 4 byte aligned
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, array.width, array.height,
+                         static_cast<GLsizei>(array.pending.size()), 0, format, GL_UNSIGNED_BYTE, nullptr);
+            for (size_t layer = 0; layer < array.pending.size(); layer++)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), array.width, array.height, 1,
+                                format, GL_UNSIGNED_BYTE, array.pending[layer]);
+                stbi_image_free(array.pending[layer]);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            array.pending.clear();
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            // stb_image's 2 components are grey and alpha
+            if (array.components == 2)
+            {
+                GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+                glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenBuffers(1, &materialBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(GpuMaterial), materials.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        built = true;
+    }
+
+    // binds every array and the material table, once per frame is enough for all meshes using the library
+    void Bind(Shader &shader) const
+    {
+        for (unsigned int i = 0; i < arrays.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i].id);
+            shader.setInt("materialArrays[" + std::to_string(i) + "]", i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_SSBO_BINDING, materialBuffer);
+    }
+
+    // number of texture binds Bind() performs
+    unsigned int ArrayCount() const { return static_cast<unsigned int>(arrays.size()); }
+
+private:
+    struct TextureArray {
+        unsigned int id;
+        int width, height, components;
+        vector<unsigned char *> pending; // decoded layers waiting for Build()
+    };
+
+    vector<TextureArray> arrays;
+    map<tuple<int, int, int>, int> formats; // (width, height, components) -> array
+    map<string, TextureSlot> slots;
+    unsigned int indexBuffer = 0;
+    unsigned int materialBuffer = 0;
+    bool built = false;
+};
+
+#endif
@@ -8,6 +8,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bounds.h"
+#include "metrics.h"
+#include "profiler.h"
 #include "shader.h"
 
 #include <string>
@@ -39,20 +42,37 @@ struct Texture {
     string path;
 };
 
+// range of a source mesh inside a mesh that several static meshes were merged into
+struct SubMesh {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int baseVertex;
+    unsigned int vertexCount;
+    AABB bounds; // in mesh space, filled in by Mesh
+};
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    vector<SubMesh>      submeshes;
+    Bounds               bounds; // in mesh space
     unsigned int VAO;
+    // entry in a MaterialLibrary, -1 when the mesh binds its own textures
+    int MaterialIndex = -1;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, without submeshes the whole mesh counts as a single one
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<SubMesh> submeshes = {})
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        if (submeshes.empty())
+            submeshes.push_back({0, static_cast<unsigned int>(indices.size()), 0, static_cast<unsigned int>(vertices.size()), AABB()});
+        this->submeshes = submeshes;
+        computeBounds();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
@@ -60,6 +80,21 @@ public:
 
     // render the mesh
     void Draw(Shader &shader)
+    {
+        PROFILE_ZONE("Mesh::Draw");
+        BindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        DrawElements();
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the mesh's textures to consecutive texture units and points the matching samplers at them
+    void BindTextures(Shader &shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -86,20 +121,65 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+        Metrics::TextureBinds.Add(textures.size());
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // issues the draw call only, program, textures and VAO are expected to be bound already
+    void DrawElements()
+    {
+        drawRange(0, static_cast<unsigned int>(indices.size()));
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // like DrawElements, but only draws one of the meshes this one was merged from
+    void DrawSubMesh(unsigned int i)
+    {
+        drawRange(submeshes[i].firstIndex, submeshes[i].indexCount);
+    }
+
+    // identifies the mesh's material by the textures it binds and its MaterialLibrary entry, meshes with equal
+    // keys can share texture bindings and sort next to each other
+    unsigned int MaterialKey() const
+    {
+        unsigned int key = 2166136261u; // FNV-1a over the GL texture ids, a whole id per step rather than a byte
+        for (const Texture &texture : textures)
+        {
+            key ^= texture.id;
+            key *= 16777619u;
+        }
+        key ^= static_cast<unsigned int>(MaterialIndex);
+        key *= 16777619u;
+        return key;
     }
 
 private:
     // render data
     unsigned int VBO, EBO;
 
+    // bounding volumes of the whole mesh and the box of each submesh
+    void computeBounds()
+    {
+        auto position = [](const Vertex &vertex) { return vertex.Position; };
+        bounds = Bounds::FromPoints(vertices.begin(), vertices.end(), position);
+        for (SubMesh &submesh : submeshes)
+        {
+            auto first = vertices.begin() + submesh.baseVertex;
+            submesh.bounds = Bounds::FromPoints(first, first + submesh.vertexCount, position).box;
+        }
+    }
+
+    void drawRange(unsigned int firstIndex, unsigned int count)
+    {
+        void *offset = (void*)(firstIndex * sizeof(unsigned int));
+        if (MaterialIndex < 0)
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset);
+        else
+            // the material index reaches the shader through an instanced attribute, offset by baseInstance
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset, 1, MaterialIndex);
+        Metrics::DrawCalls.Add();
+        Metrics::Triangles.Add(count / 3);
+        Metrics::Vertices.Add(count);
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -0,0 +1,241 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// One value the registry tracks. A counter is added to during the frame from any thread and starts from zero again
+// each frame, a gauge is set to the frame's value. Either way updates are a relaxed atomic, no locks.
+class Metric {
+public:
+    const char *const name; // lower_snake_case with a unit suffix where there is one
+    const char *const help;
+    const bool counter;
+
+    Metric(const char *name, const char *help, bool counter) : name(name), help(help), counter(counter)
+    {
+        lock_guard<mutex> lock(registryMutex());
+        registry().push_back(this);
+    }
+
+    Metric(const Metric &) = delete;
+    Metric &operator=(const Metric &) = delete;
+
+    void Add(uint64_t amount = 1) { frameCount.fetch_add(amount, memory_order_relaxed); }
+    void Set(double value) { frameValue.store(value, memory_order_relaxed); }
+
+    // the last ended frame's value
+    double LastFrame() const { return last; }
+    // a counter's sum over every ended frame
+    uint64_t Total() const { return total; }
+
+private:
+    friend class Metrics;
+
+    atomic<uint64_t> frameCount{0};
+    atomic<double> frameValue{0.0};
+    // aggregated by Metrics::EndFrame on the main thread
+    double last = 0.0;
+    uint64_t total = 0;
+    double periodSum = 0.0, periodMax = 0.0;
+
+    static vector<Metric*> &registry()
+    {
+        static vector<Metric*> metrics;
+        return metrics;
+    }
+
+    static mutex &registryMutex()
+    {
+        static mutex registered;
+        return registered;
+    }
+};
+
+// The renderer's frame metrics, aggregated per frame and exported every few seconds as a JSON line and as a
+// Prometheus text file.
+//
+// Anything can feed the metrics below from any thread: Mesh counts its draws, triangles, vertices and texture
+// binds as it issues them, the render loop adds what its passes report. EndFrame closes the frame on the main
+// thread, and once an export interval has passed writes the frames since the last export: a line appended to the
+// JSON lines file with each counter's per-frame average and total and each gauge's average and maximum, and the
+// Prometheus file replaced whole, counters as learnopengl_<name>_total and gauges as the interval's average, for
+// node_exporter's textfile collector to pick up. Other metrics can be added anywhere as static Metric instances.
+class Metrics {
+public:
+    static inline Metric DrawCalls{"draw_calls", "Draw calls issued", true};
+    static inline Metric Triangles{"triangles", "Triangles submitted in draw calls", true};
+    static inline Metric Vertices{"vertices", "Indices submitted in draw calls, each a vertex shader invocation before caching", true};
+    static inline Metric StateChanges{"state_changes", "Program, material and vertex array switches between draws", true};
+    static inline Metric UniformUploads{"uniform_uploads", "Per-draw glUniform calls", true};
+    static inline Metric TextureBinds{"texture_binds", "Textures and texture arrays bound", true};
+    static inline Metric BytesUploaded{"uploaded_bytes", "Bytes written to buffers and textures", true};
+    static inline Metric ObjectsCulled{"culled_objects", "Objects culled by the frustum or occlusion", true};
+    static inline Metric FrameMilliseconds{"frame_milliseconds", "Wall time of the frame", false};
+    static inline Metric CpuMilliseconds{"frame_cpu_milliseconds", "CPU time of the frame, input to swap", false};
+    static inline Metric GpuMilliseconds{"frame_gpu_milliseconds", "GPU time of the frame", false};
+    static inline Metric ResidentBytes{"resident_memory_bytes", "Resident memory of the process", false};
+
+    // exports every intervalSeconds, either path may be empty to skip that format
+    static bool SetExport(const string &jsonPath, const string &prometheusPath, double intervalSeconds)
+    {
+        if (!jsonPath.empty())
+        {
+            json.open(jsonPath, ios::app);
+            if (!json)
+            {
+                cout << "ERROR::METRICS:: can't write " << jsonPath << endl;
+                return false;
+            }
+            // byte counts run to more digits than the default six
+            json.precision(12);
+        }
+        prometheus = prometheusPath;
+        interval = intervalSeconds;
+        exporting = json.is_open() || !prometheus.empty();
+        lastExport = Clock::now();
+        return true;
+    }
+
+    static bool IsExporting() { return exporting; }
+
+    static void EndFrame()
+    {
+        if (exporting)
+            ResidentBytes.Set(static_cast<double>(residentBytes()));
+        lock_guard<mutex> lock(Metric::registryMutex());
+        for (Metric *metric : Metric::registry())
+        {
+            if (metric->counter)
+            {
+                uint64_t count = metric->frameCount.exchange(0, memory_order_relaxed);
+                metric->total += count;
+                metric->last = static_cast<double>(count);
+            }
+            else
+                metric->last = metric->frameValue.load(memory_order_relaxed);
+            metric->periodSum += metric->last;
+            metric->periodMax = periodFrames == 0 ? metric->last : max(metric->periodMax, metric->last);
+        }
+        frames++;
+        periodFrames++;
+        if (exporting && chrono::duration<double>(Clock::now() - lastExport).count() >= interval)
+            exportPeriod();
+    }
+
+    static uint64_t Frames() { return frames; }
+
+    // every registered metric in the order they registered, which never changes
+    template <typename Function>
+    static void ForEach(Function function)
+    {
+        lock_guard<mutex> lock(Metric::registryMutex());
+        for (const Metric *metric : Metric::registry())
+            function(*metric);
+    }
+
+private:
+    using Clock = chrono::steady_clock;
+
+    static inline ofstream json;
+    static inline string prometheus;
+    static inline double interval = 10.0;
+    static inline bool exporting = false;
+    static inline const Clock::time_point start = Clock::now();
+    static inline Clock::time_point lastExport;
+    static inline uint64_t frames = 0;
+    static inline unsigned int periodFrames = 0;
+
+    // registryMutex held
+    static void exportPeriod()
+    {
+        const vector<Metric*> &metrics = Metric::registry();
+        if (json.is_open())
+        {
+            json << "{\"time\": " << chrono::duration<double>(Clock::now() - start).count() << ", \"frames\": " << periodFrames;
+            for (const Metric *metric : metrics)
+            {
+                json << ", \"" << metric->name << "\": " << metric->periodSum / periodFrames;
+                if (metric->counter)
+                    json << ", \"" << metric->name << "_total\": " << metric->total;
+                else
+                    json << ", \"" << metric->name << "_max\": " << metric->periodMax;
+            }
+            json << "}" << endl;
+        }
+        if (!prometheus.empty())
+            writePrometheus(metrics);
+
+        for (Metric *metric : Metric::registry())
+            metric->periodSum = metric->periodMax = 0.0;
+        periodFrames = 0;
+        lastExport = Clock::now();
+    }
+
+    // written next to the file and renamed over it, so a scrape never reads half a file
+    static void writePrometheus(const vector<Metric*> &metrics)
+    {
+        string temporary = prometheus + ".tmp";
+        {
+            ofstream file(temporary);
+            if (!file)
+            {
+                cout << "ERROR::METRICS:: can't write " << temporary << endl;
+                return;
+            }
+            file.precision(12);
+            file << "# HELP learnopengl_frames_total Frames rendered\n# TYPE learnopengl_frames_total counter\n"
+                 << "learnopengl_frames_total " << frames << "\n";
+            for (const Metric *metric : metrics)
+            {
+                string name = string("learnopengl_") + metric->name + (metric->counter ? "_total" : "");
+                file << "# HELP " << name << " " << metric->help << "\n# TYPE " << name << " " << (metric->counter ? "counter" : "gauge")
+                     << "\n" << name << " ";
+                if (metric->counter)
+                    file << metric->total << "\n";
+                else
+                    file << metric->periodSum / periodFrames << "\n";
+            }
+        }
+        if (rename(temporary.c_str(), prometheus.c_str()) != 0)
+        {
+            // Windows won't rename over an existing file
+            remove(prometheus.c_str());
+            if (rename(temporary.c_str(), prometheus.c_str()) != 0)
+                cout << "ERROR::METRICS:: can't replace " << prometheus << endl;
+        }
+    }
+
+    static uint64_t residentBytes()
+    {
+#ifdef __linux__
+        // statm is in pages: total program size, then resident
+        unsigned long long size = 0, resident = 0;
+        FILE *statm = fopen("/proc/self/statm", "r");
+        if (!statm)
+            return 0;
+        if (fscanf(statm, "%llu %llu", &size, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+        return 0;
+#endif
+    }
+};
+
+#endif
@@ -7,14 +7,23 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include "stb_image.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "frustum.h"
+#include "job_system.h"
+#include "material.h"
 #include "mesh.h"
+#include "occlusion.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "scene_graph.h"
 #include "shader.h"
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -26,66 +35,135 @@ using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// a mesh as imported, before any GL buffers exist, so load-time passes can still rework it
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;
+    int materialIndex = -1;
+    vector<SubMesh> submeshes;
+    unsigned int node = 0; // scene graph node the mesh hangs from
+};
+
 class Model {
 public:
     // model data
     vector<Texture> textures_loaded;    // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh> meshes;
+    // the file's node hierarchy, node 0 is its root. Move the model by changing the root's local transform.
+    SceneGraph graph;
+    vector<unsigned int> meshNodes; // graph node of each mesh
+    AABB bounds; // of all meshes as placed by the file's hierarchy, in model space
     string directory;
+    // named after the file, for timing the model's draws, e.g. with a GpuScope
+    const ProfileZone *profileZone = nullptr;
     bool gammaCorrection;
+    // when set, textures are packed into the library's arrays instead of being loaded one by one
+    MaterialLibrary *materials;
+    // when set, meshes sharing a material are merged into one at load time, see batchByMaterial
+    bool staticBatching;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma) {
+    Model(string const &path, bool gamma = false, MaterialLibrary *materials = nullptr, bool staticBatching = false)
+            : gammaCorrection(gamma), materials(materials), staticBatching(staticBatching) {
         loadModel(path);
     }
 
+    // recomputes the world matrices of nodes moved since the last call, call once per frame before drawing
+    unsigned int Update() {
+        return graph.Update();
+    }
+
+    // world matrix of a mesh, from its node in the graph
+    const glm::mat4 &MeshTransform(unsigned int mesh) const {
+        return graph.World(meshNodes[mesh]);
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader) {
-        for (unsigned int i = 0; i < meshes.size(); i++)
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            shader.setMat4("model", MeshTransform(i));
             meshes[i].Draw(shader);
-    }
-
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path) {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                                                       aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+    }
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    // queues all meshes for sorted submission, the queue sets the model matrix per draw when it's flushed
+    void Draw(Shader &shader, RenderQueue &queue, const glm::mat4 &view, RenderLayer layer = LAYER_OPAQUE) {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            queue.Submit(shader, meshes[i], MeshTransform(i), viewDepth(meshes[i], MeshTransform(i), view), layer);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene) {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-            // the node object only contains indices to index the actual objects in the scene.
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
-        }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
-        }
+    // like the Draw above, but only queues the meshes whose world-space bounds intersect the frustum and, when an
+    // occlusion culler is given, aren't hidden behind the occluders rasterized into it. Meshes merged by static
+    // batching are tested part by part as well, and a batch that is only partly visible queues just its visible
+    // submeshes. With a job system the occlusion tests and recording are spread over its workers, each recording
+    // into its own command list, so the queue needs a list per job system thread. The frustum test of whole meshes
+    // stays on this thread, it's SIMD already.
+    void Draw(Shader &shader, RenderQueue &queue, FrustumCuller &culler, const Frustum &frustum,
+              const glm::mat4 &view, OcclusionCuller *occlusion = nullptr, RenderLayer layer = LAYER_OPAQUE,
+              JobSystem *jobs = nullptr) {
+        PROFILE_ZONE("Model::Draw");
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            culler.Add(meshes[i].bounds.box.Transformed(MeshTransform(i)));
+        culler.Cull(frustum, visibleMeshes);
+
+        auto record = [&](size_t begin, size_t end) {
+            CommandList &list = queue.List(jobs ? JobSystem::CurrentWorker() : 0);
+            unsigned int tested = 0, occluded = 0;
+            double testMicroseconds = 0.0;
+            vector<char> submeshVisible; // local, ranges are recorded on several workers at once
+            auto notOccluded = [&](const AABB &box) {
+                if (!occlusion)
+                    return true;
+                auto start = chrono::high_resolution_clock::now();
+                bool visible = occlusion->Test(box);
+                testMicroseconds += chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+                tested++;
+                if (!visible)
+                    occluded++;
+                return visible;
+            };
+            for (size_t v = begin; v < end; v++) {
+                unsigned int i = visibleMeshes[v];
+                Mesh &mesh = meshes[i];
+                const glm::mat4 &model = MeshTransform(i);
+                if (!notOccluded(mesh.bounds.box.Transformed(model)))
+                    continue;
+                float depth = viewDepth(mesh, model, view);
+                if (mesh.submeshes.size() < 2) {
+                    list.Draw(shader, mesh, model, depth, layer);
+                    continue;
+                }
 
+                // a batch: draw it whole when every part is visible, otherwise only the parts that are
+                submeshVisible.resize(mesh.submeshes.size());
+                size_t visibleCount = 0;
+                for (size_t s = 0; s < mesh.submeshes.size(); s++) {
+                    AABB box = mesh.submeshes[s].bounds.Transformed(model);
+                    submeshVisible[s] = frustum.Intersects(box) && notOccluded(box);
+                    visibleCount += submeshVisible[s];
+                }
+                if (visibleCount == mesh.submeshes.size())
+                    list.Draw(shader, mesh, model, depth, layer);
+                else
+                    for (size_t s = 0; s < mesh.submeshes.size(); s++)
+                        if (submeshVisible[s])
+                            list.Draw(shader, mesh, model, depth, layer, static_cast<int>(s));
+            }
+            if (occlusion)
+                occlusion->CountTests(tested, occluded, testMicroseconds);
+        };
+        if (jobs)
+            jobs->ParallelFor(visibleMeshes.size(), RECORD_GRAIN, record);
+        else
+            record(0, visibleMeshes.size());
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene) {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+    // converts an assimp mesh's vertices and faces into data's vertices and indices, the first half of loading a
+    // mesh; materials need the rest of the scene and are processMesh's business
+    static void ImportGeometry(const aiMesh *mesh, MeshData &data) {
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -134,8 +212,123 @@ private:
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+    }
+
+private:
+    // meshes per recording job
+    static constexpr size_t RECORD_GRAIN = 64;
+
+    // meshes read from the file, waiting to be uploaded
+    vector<MeshData> imported;
+    // scratch list for culling, kept to avoid allocating every frame
+    vector<unsigned int> visibleMeshes;
+
+    // distance of the mesh's center in front of the camera, which looks down -z in view space
+    static float viewDepth(const Mesh &mesh, const glm::mat4 &model, const glm::mat4 &view) {
+        return -(view * model * glm::vec4(mesh.bounds.sphere.center, 1.0f)).z;
+    }
+
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const &path) {
+        PROFILE_ZONE("Model::loadModel");
+        // read file via ASSIMP
+        Assimp::Importer importer;
+        const aiScene *scene;
+        {
+            PROFILE_ZONE("Assimp::ReadFile");
+            scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                                            aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        }
+        // check for errors
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return;
+        }
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        profileZone = Profiler::Intern("Model " + path.substr(path.find_last_of('/') + 1), __FILE__, __LINE__);
+
+        // process ASSIMP's root node recursively
+        processNode(scene->mRootNode, scene, SceneGraph::NONE);
+        graph.Update();
+
+        // merge before uploading so the merged meshes are the only buffers ever created
+        if (staticBatching) {
+            for (MeshData &data : imported)
+                bakeIntoRoot(data);
+            imported = batchByMaterial(imported);
+        }
+        for (MeshData &data : imported) {
+            meshNodes.push_back(data.node);
+            meshes.push_back(uploadMesh(data));
+        }
+        imported.clear();
+
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bounds.Expand(meshes[i].bounds.box.Transformed(MeshTransform(i)));
+    }
+
+    // assimp matrices are row major
+    static glm::mat4 toGlm(const aiMatrix4x4 &matrix) {
+        return glm::transpose(glm::make_mat4(&matrix.a1));
+    }
+
+    // a merged mesh can only follow one node, so meshes are moved into the root's space before batching. Static
+    // geometry ends up where the hierarchy put it and the whole model still moves with the root.
+    void bakeIntoRoot(MeshData &data) {
+        if (data.node == 0)
+            return;
+        glm::mat4 transform = glm::inverse(graph.World(0)) * graph.World(data.node);
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        for (Vertex &vertex : data.vertices) {
+            vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+            vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+            vertex.Tangent = glm::mat3(transform) * vertex.Tangent;
+            vertex.Bitangent = glm::mat3(transform) * vertex.Bitangent;
+        }
+        data.node = 0;
+    }
+
+    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode *node, const aiScene *scene, unsigned int parent) {
+        // keep the node and its transform, meshes hang from it
+        unsigned int graphNode = graph.AddNode(parent, toGlm(node->mTransformation), node->mName.C_Str());
+        // process each mesh located at the current node
+        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+            // the node object only contains indices to index the actual objects in the scene.
+            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
+            imported.push_back(processMesh(mesh, scene));
+            imported.back().node = graphNode;
+        }
+        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+            processNode(node->mChildren[i], scene, graphNode);
+        }
+
+    }
+
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene) {
+        PROFILE_ZONE("Model::processMesh");
+        // data to fill
+        MeshData data;
+        vector<Texture> &textures = data.textures;
+        ImportGeometry(mesh, data);
+
         // process materials
         aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+        if (materials) {
+            // same texture type convention as below, packed into the library's arrays
+            GpuMaterial gpuMaterial;
+            gpuMaterial.diffuse = loadMaterialSlot(material, aiTextureType_DIFFUSE);
+            gpuMaterial.specular = loadMaterialSlot(material, aiTextureType_SPECULAR);
+            gpuMaterial.normal = loadMaterialSlot(material, aiTextureType_HEIGHT);
+            gpuMaterial.height = loadMaterialSlot(material, aiTextureType_AMBIENT);
+
+            data.materialIndex = static_cast<int>(materials->AddMaterial(gpuMaterial));
+            return data;
+        }
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
         // Same applies to other texture as the following list summarizes:
@@ -156,8 +349,61 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it's uploaded once the whole file has been read
+        return data;
+    }
+
+    // creates the GL side of an imported mesh
+    Mesh uploadMesh(MeshData &data) {
+        PROFILE_ZONE("Model::uploadMesh");
+        Mesh mesh(std::move(data.vertices), std::move(data.indices), std::move(data.textures), std::move(data.submeshes));
+        if (data.materialIndex >= 0) {
+            mesh.MaterialIndex = data.materialIndex;
+            materials->Attach(mesh.VAO);
+        }
+        return mesh;
+    }
+
+    // merges meshes that bind the same material into one mesh per material, in order of first appearance. Vertex
+    // and index data are concatenated with the indices rebased, and each source mesh is kept as a SubMesh range so
+    // it can still be culled or picked on its own. The result is fewer, larger draws at no cost per frame.
+    vector<MeshData> batchByMaterial(vector<MeshData> &source) {
+        PROFILE_ZONE("Model::batchByMaterial");
+        vector<MeshData> batches;
+        map<pair<vector<unsigned int>, int>, size_t> batchOf; // (texture names, material index) -> batch
+        for (MeshData &data : source) {
+            vector<unsigned int> textureIds;
+            for (const Texture &texture : data.textures)
+                textureIds.push_back(texture.id);
+            auto key = make_pair(textureIds, data.materialIndex);
+            auto found = batchOf.find(key);
+            if (found == batchOf.end()) {
+                found = batchOf.emplace(key, batches.size()).first;
+                MeshData batch;
+                batch.textures = data.textures;
+                batch.materialIndex = data.materialIndex;
+                batches.push_back(batch);
+            }
+
+            MeshData &batch = batches[found->second];
+            unsigned int baseVertex = static_cast<unsigned int>(batch.vertices.size());
+            unsigned int firstIndex = static_cast<unsigned int>(batch.indices.size());
+            batch.vertices.insert(batch.vertices.end(), data.vertices.begin(), data.vertices.end());
+            for (unsigned int index : data.indices)
+                batch.indices.push_back(index + baseVertex);
+            batch.submeshes.push_back({firstIndex, static_cast<unsigned int>(data.indices.size()),
+                                       baseVertex, static_cast<unsigned int>(data.vertices.size()), AABB()});
+        }
+        return batches;
+    }
+
+    // queues the first texture of the given type in the material library and returns where it will live.
+    TextureSlot loadMaterialSlot(aiMaterial *mat, aiTextureType type) {
+        if (mat->GetTextureCount(type) == 0)
+            return TextureSlot();
+        aiString str;
+        mat->GetTexture(type, 0, &str);
+        return materials->AddTexture(directory + '/' + str.C_Str());
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -0,0 +1,413 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "job_system.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Simplified stand-in for a mesh when it's used as an occluder: a triangle soup of the mesh's largest triangles.
+// Dropping triangles can only make an occluder smaller, so the simplification never hides anything that's visible.
+struct OccluderMesh {
+    vector<glm::vec3> positions; // three per triangle, in mesh space
+    AABB bounds;
+    unsigned int mesh = 0; // index of the source mesh in the list given to SelectFrom, for its transform
+
+    static OccluderMesh FromMesh(const Mesh &mesh, size_t maxTriangles)
+    {
+        size_t triangleCount = mesh.indices.size() / 3;
+        vector<pair<float, size_t>> areas(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            const glm::vec3 &a = mesh.vertices[mesh.indices[3 * i]].Position;
+            const glm::vec3 &b = mesh.vertices[mesh.indices[3 * i + 1]].Position;
+            const glm::vec3 &c = mesh.vertices[mesh.indices[3 * i + 2]].Position;
+            areas[i] = {glm::length(glm::cross(b - a, c - a)), i};
+        }
+        size_t kept = min(maxTriangles, triangleCount);
+        partial_sort(areas.begin(), areas.begin() + kept, areas.end(),
+                     [](const pair<float, size_t> &a, const pair<float, size_t> &b) { return a.first > b.first; });
+
+        OccluderMesh occluder;
+        for (size_t i = 0; i < kept; i++)
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const glm::vec3 &position = mesh.vertices[mesh.indices[3 * areas[i].second + corner]].Position;
+                occluder.positions.push_back(position);
+                occluder.bounds.Expand(position);
+            }
+        return occluder;
+    }
+
+    // picks the meshes worth rasterizing: those at least minRadiusFraction as big as the biggest one
+    static vector<OccluderMesh> SelectFrom(const vector<Mesh> &meshes, float minRadiusFraction = 0.5f, size_t maxTriangles = 256)
+    {
+        float largest = 0.0f;
+        for (const Mesh &mesh : meshes)
+            largest = max(largest, mesh.bounds.sphere.radius);
+
+        vector<OccluderMesh> occluders;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            if (meshes[i].bounds.sphere.radius >= largest * minRadiusFraction && !meshes[i].indices.empty())
+            {
+                occluders.push_back(FromMesh(meshes[i], maxTriangles));
+                occluders.back().mesh = i;
+            }
+        return occluders;
+    }
+};
+
+// counters for one frame of occlusion culling
+struct OcclusionStats {
+    unsigned int triangles = 0; // occluder triangles set up for rasterization
+    unsigned int tested = 0;
+    unsigned int occluded = 0;
+    double rasterMicroseconds = 0.0;
+    double testMicroseconds = 0.0;
+
+    float OccludedPercent() const { return tested ? 100.0f * occluded / tested : 0.0f; }
+    double Microseconds() const { return rasterMicroseconds + testMicroseconds; }
+};
+
+// CPU occlusion culling against a small software depth buffer.
+//
+// Per frame: BeginFrame() with the view-projection matrix, AddOccluder() for each occluder, Rasterize(), then
+// IsVisible() for every occludee box and EndFrame(). Occluders are rasterized 4 pixels at a time with SSE2, the
+// buffer is split into tiles that the job system's workers pick up independently, and a max-depth hierarchy is
+// built on top so an occludee costs at most 4x4 texel reads. Depth is NDC z, larger is farther; pixels no occluder covers
+// hold EMPTY so nothing is ever hidden behind them. Occluders are sampled at pixel centres, so a pixel could take
+// the depth of an occluder that only covers part of it. Before the hierarchy is built, every pixel takes the
+// farthest depth of the 3x3 samples around it. Any point of the pixel lies between four of those samples, so the
+// pixel keeps a depth only when the occluders cover all of it, and only the farthest depth they have there. That
+// holds wherever the occluders' outline is convex at the scale of a pixel. A gap between two occluders narrower
+// than a pixel can still fall between the samples. Nothing here touches GL, so it can run (and be tested) without
+// a context, see tests/occlusion_test.cpp.
+class OcclusionCuller {
+public:
+    static const int TILE_WIDTH = 64;
+    static const int TILE_HEIGHT = 32;
+    static constexpr float EMPTY = FLT_MAX;
+
+    // width and height are rounded up to whole tiles. Without a job system the tiles are rasterized in turn.
+    OcclusionCuller(int width = 256, int height = 128, JobSystem *jobs = nullptr)
+        : width((width + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH),
+          height((height + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT),
+          jobs(jobs)
+    {
+        for (int w = this->width, h = this->height;; w = (w + 1) / 2, h = (h + 1) / 2)
+        {
+            levels.push_back(Level{w, h, vector<float>(static_cast<size_t>(w) * h, EMPTY)});
+            if (w == 1 && h == 1)
+                break;
+        }
+    }
+
+    void BeginFrame(const glm::mat4 &viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+    }
+
+    // transforms the occluder's triangles to screen space, triangles crossing the near plane are skipped
+    void AddOccluder(const OccluderMesh &occluder, const glm::mat4 &model)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        glm::mat4 transform = viewProjection * model;
+        for (size_t i = 0; i + 2 < occluder.positions.size(); i += 3)
+        {
+            glm::vec3 screen[3];
+            bool clipped = false;
+            for (int corner = 0; corner < 3 && !clipped; corner++)
+                clipped = !toScreen(transform * glm::vec4(occluder.positions[i + corner], 1.0f), screen[corner]);
+            if (!clipped)
+                setupTriangle(screen[0], screen[1], screen[2]);
+        }
+        frameStats.rasterMicroseconds += elapsed(start);
+    }
+
+    // rasterizes every added occluder, then builds the depth hierarchy
+    void Rasterize()
+    {
+        auto start = chrono::high_resolution_clock::now();
+        frameStats.triangles += static_cast<unsigned int>(triangles.size());
+
+        int tilesX = width / TILE_WIDTH, tileCount = tilesX * (height / TILE_HEIGHT);
+        auto rasterizeTiles = [&](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++)
+                rasterizeTile(static_cast<int>(tile % tilesX) * TILE_WIDTH, static_cast<int>(tile / tilesX) * TILE_HEIGHT);
+        };
+        if (jobs)
+            jobs->ParallelFor(tileCount, 1, rasterizeTiles);
+        else
+            rasterizeTiles(0, tileCount);
+
+        erode();
+        buildHierarchy();
+        frameStats.rasterMicroseconds += elapsed(start);
+    }
+
+    // false when the box is certainly hidden behind the rasterized occluders
+    bool IsVisible(const AABB &box)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        bool visible = Test(box);
+        CountTests(1, visible ? 0 : 1, elapsed(start));
+        return visible;
+    }
+
+    // IsVisible without the bookkeeping, safe to call from several threads at once once Rasterize() is done.
+    // Callers add up their own counts and report them through CountTests.
+    bool Test(const AABB &box) const
+    {
+        return testBox(box);
+    }
+
+    void CountTests(unsigned int tested, unsigned int occluded, double microseconds)
+    {
+        lock_guard<mutex> lock(statsMutex);
+        frameStats.tested += tested;
+        frameStats.occluded += occluded;
+        frameStats.testMicroseconds += microseconds;
+    }
+
+    void EndFrame()
+    {
+        lastFrameStats = frameStats;
+        frameStats = OcclusionStats();
+    }
+
+    const OcclusionStats &LastFrameStats() const { return lastFrameStats; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+    // full resolution depth after erosion, row-major from the bottom row up
+    const vector<float> &DepthBuffer() const { return levels[0].depth; }
+
+private:
+    // edge functions E(x, y) = a x + b y + c, positive inside, and the depth plane z = za x + zb y + zc
+    struct Triangle {
+        float a[3], b[3], c[3];
+        float za, zb, zc;
+        int minX, minY, maxX, maxY;
+    };
+
+    struct Level {
+        int width, height;
+        vector<float> depth;
+    };
+
+    int width, height;
+    JobSystem *jobs;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    vector<Triangle> triangles;
+    vector<Level> levels;
+    vector<float> rowMax; // scratch for erode
+    OcclusionStats frameStats, lastFrameStats;
+    mutex statsMutex;
+
+    static double elapsed(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // clip space to pixel coordinates and NDC depth, false when the point is behind the near plane
+    bool toScreen(const glm::vec4 &clip, glm::vec3 &screen) const
+    {
+        if (clip.w <= 1e-5f || clip.z < -clip.w)
+            return false;
+        float invW = 1.0f / clip.w;
+        screen.x = (clip.x * invW * 0.5f + 0.5f) * width;
+        screen.y = (clip.y * invW * 0.5f + 0.5f) * height;
+        screen.z = clip.z * invW;
+        return true;
+    }
+
+    void setupTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
+    {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        // occluders are rasterized double-sided, so flip clockwise triangles to keep the edge functions positive
+        if (area < 0.0f)
+        {
+            swap(v1, v2);
+            area = -area;
+        }
+
+        Triangle t;
+        t.minX = max(0, static_cast<int>(std::floor(min({v0.x, v1.x, v2.x}))));
+        t.minY = max(0, static_cast<int>(std::floor(min({v0.y, v1.y, v2.y}))));
+        t.maxX = min(width - 1, static_cast<int>(std::ceil(max({v0.x, v1.x, v2.x}))));
+        t.maxY = min(height - 1, static_cast<int>(std::ceil(max({v0.y, v1.y, v2.y}))));
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+
+        const glm::vec3 *v[3] = {&v0, &v1, &v2};
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3 &from = *v[(e + 1) % 3], &to = *v[(e + 2) % 3]; // edge e is opposite vertex e
+            t.a[e] = from.y - to.y;
+            t.b[e] = to.x - from.x;
+            t.c[e] = from.x * to.y - from.y * to.x;
+        }
+        // the edge functions divided by the area are the barycentrics, which interpolate z
+        float invArea = 1.0f / area;
+        t.za = (t.a[0] * v0.z + t.a[1] * v1.z + t.a[2] * v2.z) * invArea;
+        t.zb = (t.b[0] * v0.z + t.b[1] * v1.z + t.b[2] * v2.z) * invArea;
+        t.zc = (t.c[0] * v0.z + t.c[1] * v1.z + t.c[2] * v2.z) * invArea;
+        triangles.push_back(t);
+    }
+
+    void rasterizeTile(int tileX, int tileY)
+    {
+        vector<float> &depth = levels[0].depth;
+        for (int y = tileY; y < tileY + TILE_HEIGHT; y++)
+            fill(depth.begin() + y * width + tileX, depth.begin() + y * width + tileX + TILE_WIDTH, EMPTY);
+
+        for (const Triangle &t : triangles)
+        {
+            int minX = max(t.minX, tileX), maxX = min(t.maxX, tileX + TILE_WIDTH - 1);
+            int minY = max(t.minY, tileY), maxY = min(t.maxY, tileY + TILE_HEIGHT - 1);
+            if (minX > maxX || minY > maxY)
+                continue;
+            // start rows on a multiple of 4 so every 4-wide step stays inside the tile
+            minX &= ~3;
+            for (int y = minY; y <= maxY; y++)
+                rasterizeSpan(t, depth.data() + y * width, minX, maxX, y + 0.5f);
+        }
+    }
+
+    // depth-tests pixels [minX, maxX] of one row against the triangle, keeping the nearest depth
+    static void rasterizeSpan(const Triangle &t, float *row, int minX, int maxX, float py)
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 rowE[3], stepE[3];
+        for (int e = 0; e < 3; e++)
+        {
+            rowE[e] = _mm_set1_ps(t.b[e] * py + t.c[e]);
+            stepE[e] = _mm_set1_ps(t.a[e]);
+        }
+        __m128 rowZ = _mm_set1_ps(t.zb * py + t.zc), stepZ = _mm_set1_ps(t.za);
+        for (int x = minX; x <= maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepE[0], px), rowE[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepE[1], px), rowE[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepE[2], px), rowE[2]), zero));
+            if (!_mm_movemask_ps(inside))
+                continue;
+            __m128 z = _mm_add_ps(_mm_mul_ps(stepZ, px), rowZ);
+            __m128 current = _mm_loadu_ps(row + x);
+            __m128 nearest = _mm_min_ps(current, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+#else
+        for (int x = minX; x <= maxX; x++)
+        {
+            float px = x + 0.5f;
+            bool inside = true;
+            for (int e = 0; e < 3; e++)
+                inside = inside && t.a[e] * px + t.b[e] * py + t.c[e] >= 0.0f;
+            if (inside)
+                row[x] = min(row[x], t.za * px + t.zb * py + t.zc);
+        }
+#endif
+    }
+
+    // every pixel takes the farthest depth of itself and its 8 neighbours, as a max over each row and then each
+    // column. Off-screen neighbours don't count, nothing past the edge can be seen anyway.
+    void erode()
+    {
+        vector<float> &depth = levels[0].depth;
+        rowMax.resize(depth.size());
+        for (int y = 0; y < height; y++)
+        {
+            const float *row = depth.data() + y * width;
+            float *out = rowMax.data() + y * width;
+            for (int x = 0; x < width; x++)
+                out[x] = max({row[max(x - 1, 0)], row[x], row[min(x + 1, width - 1)]});
+        }
+        for (int y = 0; y < height; y++)
+        {
+            const float *below = rowMax.data() + max(y - 1, 0) * width, *row = rowMax.data() + y * width;
+            const float *above = rowMax.data() + min(y + 1, height - 1) * width;
+            for (int x = 0; x < width; x++)
+                depth[y * width + x] = max({below[x], row[x], above[x]});
+        }
+    }
+
+    // each level keeps the farthest depth of the (up to) 2x2 texels below it, odd sizes round up
+    void buildHierarchy()
+    {
+        for (size_t l = 1; l < levels.size(); l++)
+        {
+            const Level &fine = levels[l - 1];
+            Level &coarse = levels[l];
+            for (int y = 0; y < coarse.height; y++)
+            {
+                int y0 = 2 * y, y1 = min(2 * y + 1, fine.height - 1);
+                for (int x = 0; x < coarse.width; x++)
+                {
+                    int x0 = 2 * x, x1 = min(2 * x + 1, fine.width - 1);
+                    coarse.depth[y * coarse.width + x] = max(max(fine.depth[y0 * fine.width + x0], fine.depth[y0 * fine.width + x1]),
+                                                             max(fine.depth[y1 * fine.width + x0], fine.depth[y1 * fine.width + x1]));
+                }
+            }
+        }
+    }
+
+    bool testBox(const AABB &box) const
+    {
+        if (box.IsEmpty())
+            return false;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point((corner & 1) ? box.max.x : box.min.x,
+                            (corner & 2) ? box.max.y : box.min.y,
+                            (corner & 4) ? box.max.z : box.min.z);
+            glm::vec3 screen;
+            // boxes reaching behind the near plane contain the camera's surroundings, never cull those
+            if (!toScreen(viewProjection * glm::vec4(point, 1.0f), screen))
+                return true;
+            minX = min(minX, screen.x);
+            minY = min(minY, screen.y);
+            maxX = max(maxX, screen.x);
+            maxY = max(maxY, screen.y);
+            nearest = min(nearest, screen.z);
+        }
+
+        int x0 = max(0, static_cast<int>(std::floor(minX))), y0 = max(0, static_cast<int>(std::floor(minY)));
+        int x1 = min(width - 1, static_cast<int>(std::floor(maxX))), y1 = min(height - 1, static_cast<int>(std::floor(maxY)));
+        if (x0 > x1 || y0 > y1)
+            return true; // off screen, that's for frustum culling to decide
+
+        // coarsest level at which the rectangle spans no more than 4x4 texels
+        size_t level = 0;
+        while (level + 1 < levels.size() && max(x1 - x0, y1 - y0) >> level >= 4)
+            level++;
+        const Level &l = levels[level];
+        for (int y = y0 >> level; y <= min(l.height - 1, y1 >> level); y++)
+            for (int x = x0 >> level; x <= min(l.width - 1, x1 >> level); x++)
+                if (nearest <= l.depth[y * l.width + x])
+                    return true;
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// where a zone is in the source, one static instance per PROFILE_ZONE so events only carry a pointer to it
+struct ProfileZone {
+    const char *name;
+    const char *file;
+    int line;
+};
+
+struct ProfileEvent {
+    const ProfileZone *zone;
+    uint64_t start;    // nanoseconds since the profiler started
+    uint64_t duration; // nanoseconds
+};
+
+// Records timed zones from any thread into per-thread rings and writes them out as a Chrome trace, which
+// chrome://tracing and ui.perfetto.dev both open.
+//
+// Each thread gets its own ring on its first event, so recording takes no locks: the thread writes the event and
+// then publishes it by bumping its ring's counter. The newest THREAD_CAPACITY events of every thread are kept.
+// WriteTrace may run while threads are still recording, events a thread overwrote while they were being copied
+// are dropped rather than written torn. When disabled a zone costs one relaxed atomic load.
+//
+// Usage: PROFILE_ZONE("name") at the top of a scope, or PROFILE_FUNCTION(), then Profiler::SetEnabled(true).
+// Building with LEARNOPENGL_NO_PROFILER compiles the zones out entirely.
+class Profiler {
+public:
+    // per thread, a power of two. 64k events is a few seconds of a busy frame loop.
+    static constexpr size_t THREAD_CAPACITY = 1 << 16;
+
+    static bool IsEnabled() { return enabled.load(memory_order_relaxed); }
+    static void SetEnabled(bool on) { enabled.store(on, memory_order_relaxed); }
+
+    // shown as the thread's track name in the trace, the ring itself isn't allocated until the first event
+    static void SetThreadName(const string &name)
+    {
+        threadName = name;
+        if (current)
+        {
+            lock_guard<mutex> lock(threadsMutex);
+            current->name = name;
+        }
+    }
+
+    static uint64_t Now()
+    {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count());
+    }
+
+    static void Record(const ProfileZone *zone, uint64_t start, uint64_t end)
+    {
+        threadBuffer()->Push(ProfileEvent{zone, start, end - start});
+    }
+
+    // a track of its own in the trace for events that don't belong to a thread, like GPU work timed after the
+    // fact. Only one thread at a time may record onto a track.
+    static unsigned int AddTrack(const string &name)
+    {
+        lock_guard<mutex> lock(threadsMutex);
+        threads.emplace_back(new ThreadBuffer());
+        ThreadBuffer *track = threads.back().get();
+        track->id = static_cast<unsigned int>(threads.size());
+        track->name = name;
+        return track->id;
+    }
+
+    static void RecordOn(unsigned int track, const ProfileZone *zone, uint64_t start, uint64_t end)
+    {
+        ThreadBuffer *buffer;
+        {
+            lock_guard<mutex> lock(threadsMutex);
+            buffer = threads[track - 1].get();
+        }
+        buffer->Push(ProfileEvent{zone, start, end - start});
+    }
+
+    // a zone for a name only known at run time, e.g. a model's file name. Zones are kept for good, one per name.
+    static const ProfileZone *Intern(const string &name, const char *file, int line)
+    {
+        lock_guard<mutex> lock(threadsMutex);
+        auto found = internedZones.find(name);
+        if (found != internedZones.end())
+            return found->second;
+        internedNames.push_back(name);
+        internedZones.emplace(name, nullptr);
+        internedZoneStorage.push_back(ProfileZone{internedNames.back().c_str(), file, line});
+        return internedZones[name] = &internedZoneStorage.back();
+    }
+
+    // the events every thread still holds that overlap from..to, as Chrome Trace Event JSON. extraEvents are
+    // more events already in that format, comma separated, e.g. counters or annotations.
+    static bool WriteTrace(const string &path, uint64_t from = 0, uint64_t to = UINT64_MAX, const string &extraEvents = "")
+    {
+        ofstream file(path);
+        if (!file)
+        {
+            cout << "ERROR::PROFILER:: can't write " << path << endl;
+            return false;
+        }
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        size_t total = 0;
+        bool first = true;
+        lock_guard<mutex> lock(threadsMutex);
+        for (const unique_ptr<ThreadBuffer> &buffer : threads)
+        {
+            if (!first)
+                file << ",\n";
+            first = false;
+            file << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << buffer->id
+                 << ", \"args\": {\"name\": \"" << EscapeJson(buffer->name) << "\"}}";
+
+            vector<ProfileEvent> events = overlapping(buffer->Snapshot(), from, to);
+            for (const ProfileEvent &event : events)
+            {
+                file << ",\n{\"ph\": \"X\", \"name\": \"" << EscapeJson(event.zone->name) << "\", \"pid\": 1, \"tid\": " << buffer->id
+                     << ", \"ts\": " << TraceTime(event.start) << ", \"dur\": " << TraceTime(event.duration)
+                     << ", \"args\": {\"file\": \"" << EscapeJson(event.zone->file) << "\", \"line\": " << event.zone->line << "}}";
+            }
+            total += events.size();
+        }
+        if (!extraEvents.empty())
+            file << ",\n" << extraEvents;
+        file << "\n]}\n";
+        cout << "profiler: " << total << " events from " << threads.size() << " threads written to " << path << endl;
+        return true;
+    }
+
+    // the calling thread's events that overlap from..to, oldest first
+    static vector<ProfileEvent> ThreadEvents(uint64_t from, uint64_t to)
+    {
+        return overlapping(threadBuffer()->Snapshot(), from, to);
+    }
+
+    // zone names and paths as JSON string contents, Windows paths are full of backslashes
+    static string EscapeJson(const string &text)
+    {
+        string result;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            result += c;
+        }
+        return result;
+    }
+
+    // nanoseconds as a trace's microseconds, the nanoseconds as three decimals
+    static string TraceTime(uint64_t nanoseconds)
+    {
+        string decimals = to_string(nanoseconds % 1000);
+        return to_string(nanoseconds / 1000) + "." + string(3 - decimals.size(), '0') + decimals;
+    }
+
+private:
+    struct ThreadBuffer {
+        unsigned int id = 0;
+        string name;
+        vector<ProfileEvent> events = vector<ProfileEvent>(THREAD_CAPACITY);
+        atomic<uint64_t> written{0};
+
+        // only ever called by the ring's owner
+        void Push(const ProfileEvent &event)
+        {
+            uint64_t index = written.load(memory_order_relaxed);
+            events[index & (THREAD_CAPACITY - 1)] = event;
+            written.store(index + 1, memory_order_release);
+        }
+
+        // copies the ring out oldest first, then drops whatever the owner may have overwritten during the copy.
+        // Once written reads after, the owner may already be writing event after, which lands in the slot of
+        // event after - THREAD_CAPACITY, so that one is dropped too.
+        vector<ProfileEvent> Snapshot() const
+        {
+            uint64_t end = written.load(memory_order_acquire);
+            uint64_t begin = end > THREAD_CAPACITY ? end - THREAD_CAPACITY : 0;
+            vector<ProfileEvent> copied;
+            copied.reserve(end - begin);
+            for (uint64_t i = begin; i < end; i++)
+                copied.push_back(events[i & (THREAD_CAPACITY - 1)]);
+            // keeps the copy above from being moved past the second read
+            atomic_thread_fence(memory_order_acquire);
+            uint64_t after = written.load(memory_order_relaxed);
+            uint64_t overwritten = after + 1 > THREAD_CAPACITY ? after + 1 - THREAD_CAPACITY : 0;
+            if (overwritten > begin)
+                copied.erase(copied.begin(), copied.begin() + min(copied.size(), static_cast<size_t>(overwritten - begin)));
+            return copied;
+        }
+    };
+
+    static inline atomic<bool> enabled{false};
+    static inline const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+    // rings outlive their threads, a finished worker's events still make it into the trace
+    static inline mutex threadsMutex;
+    static inline vector<unique_ptr<ThreadBuffer>> threads;
+    static inline thread_local ThreadBuffer *current = nullptr;
+    static inline thread_local string threadName;
+    // deques, so the zones and the names they point to never move
+    static inline deque<string> internedNames;
+    static inline deque<ProfileZone> internedZoneStorage;
+    static inline map<string, const ProfileZone*> internedZones;
+
+    static ThreadBuffer *threadBuffer()
+    {
+        if (!current)
+        {
+            lock_guard<mutex> lock(threadsMutex);
+            threads.emplace_back(new ThreadBuffer());
+            current = threads.back().get();
+            current->id = static_cast<unsigned int>(threads.size());
+            current->name = threadName.empty() ? "thread " + to_string(current->id) : threadName;
+        }
+        return current;
+    }
+
+    static vector<ProfileEvent> overlapping(vector<ProfileEvent> events, uint64_t from, uint64_t to)
+    {
+        events.erase(remove_if(events.begin(), events.end(), [from, to](const ProfileEvent &event) {
+            return event.start > to || event.start + event.duration < from;
+        }), events.end());
+        return events;
+    }
+};
+
+// times the scope it's declared in, when the profiler was enabled as it was entered
+class ProfileScope {
+public:
+    explicit ProfileScope(const ProfileZone *zone)
+    {
+        if (Profiler::IsEnabled())
+        {
+            this->zone = zone;
+            start = Profiler::Now();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (zone)
+            Profiler::Record(zone, start, Profiler::Now());
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const ProfileZone *zone = nullptr;
+    uint64_t start = 0;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef LEARNOPENGL_NO_PROFILER
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#else
+#define PROFILE_ZONE(name)                                                                                    \
+    static constexpr ProfileZone PROFILE_CONCAT(profileZone, __LINE__){name, __FILE__, __LINE__};           \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(&PROFILE_CONCAT(profileZone, __LINE__))
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#endif
+
+#endif
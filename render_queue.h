@@ -0,0 +1,330 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "profiler.h"
+#include "ring_buffer.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// Layers are drawn in ascending order; everything in a lower layer is submitted before the next one starts.
+enum RenderLayer {
+    LAYER_OPAQUE      = 0,
+    LAYER_TRANSPARENT = 1,
+    LAYER_OVERLAY     = 2
+};
+
+// Number of state switches a sequence of draws needs.
+struct StateChanges {
+    unsigned int programs  = 0;
+    unsigned int materials = 0;
+    unsigned int vaos      = 0;
+
+    unsigned int Total() const { return programs + materials + vaos; }
+};
+
+// A draw as recorded into a command list. Plain data captured at record time, so any thread can fill it in.
+// Binding the program and material and setting the model matrix are derived from it when the queue executes.
+struct DrawPacket {
+    uint64_t key;
+    Shader *shader;
+    Mesh *mesh;
+    unsigned int material;
+    unsigned int transform; // index into the recording list's transforms
+    int submesh;            // -1 draws the whole mesh
+};
+
+// Draws recorded by one thread. Recording only reads the shader and mesh and appends to vectors that keep their
+// capacity across Reset(), so once a list has seen its busiest frame it doesn't allocate any more.
+class CommandList {
+public:
+    // records a mesh, viewDepth is the distance along the camera's forward axis. With submesh set only that part
+    // of the mesh is drawn.
+    void Draw(Shader &shader, Mesh &mesh, const glm::mat4 &model, float viewDepth, RenderLayer layer = LAYER_OPAQUE,
+              int submesh = -1);
+
+    void Reset()
+    {
+        packets.clear();
+        transforms.clear();
+    }
+
+    size_t Size() const { return packets.size(); }
+
+private:
+    friend class RenderQueue;
+    vector<DrawPacket> packets;
+    vector<glm::mat4> transforms;
+};
+
+// Collects draws for a frame, orders them by a packed 64-bit sort key and submits them with the
+// fewest program/material/VAO switches.
+//
+// Draws are recorded into command lists, one per recording thread: Submit() fills list 0, worker threads fill
+// List(i) for their own i. Flush() runs on the GL thread and merges every list, sorts, and issues the GL calls,
+// which is then all the per-draw work left on that thread. With a constants ring, every draw's constants are
+// packed into one allocation per frame and a draw costs a single glBindBufferRange on top of the draw call.
+//
+// Key layout, most significant bits first:
+//   opaque & overlay: layer(2) | program(10) | material(14) | vao(14) | depth(24)
+//   transparent:      layer(2) | ~depth(24)  | program(10)  | material(14) | vao(14)
+// Opaque geometry is therefore grouped by state and drawn front to back inside each group to make the most
+// of early-z, while transparent geometry is drawn strictly back to front. The id fields only hold the low bits
+// of the GL names; a collision makes sorting less effective but never changes what gets bound.
+class RenderQueue {
+public:
+    struct Stats {
+        unsigned int draws = 0;
+        unsigned int lists = 0; // command lists that had draws in them
+        StateChanges unsorted; // switches the draws would have needed in submission order
+        StateChanges sorted;   // switches actually performed
+        unsigned int rangeBinds = 0;  // draws that picked their constants with glBindBufferRange
+        unsigned int uniformSets = 0; // draws that needed glUniform calls instead
+    };
+
+    // per-draw constants, std140 layout of the Draw block in the material-arrays vertex shader
+    struct DrawConstants {
+        glm::mat4 model;
+    };
+
+    // listCount is the number of threads that record at the same time
+    explicit RenderQueue(unsigned int listCount = 1) : lists(max(1u, listCount)) {}
+
+    // queues a mesh from the GL thread, viewDepth is the distance along the camera's forward axis
+    void Submit(Shader &shader, Mesh &mesh, const glm::mat4 &model, float viewDepth, RenderLayer layer = LAYER_OPAQUE)
+    {
+        lists[0].Draw(shader, mesh, model, viewDepth, layer);
+    }
+
+    // streams per-draw constants through ring into the Draw uniform block at binding. Programs without a Draw
+    // block keep getting the model matrix as a plain uniform.
+    void UseConstantsBuffer(RingBuffer *ring, GLuint binding)
+    {
+        constantsRing = ring;
+        constantsBinding = binding;
+    }
+
+    // the list thread i records into, no two threads may record into the same list at once. Takes a
+    // JobSystem::CurrentWorker(), which is -1 on threads the job system doesn't own, so those can't record.
+    CommandList &List(int i)
+    {
+        assert(i >= 0 && static_cast<unsigned int>(i) < lists.size());
+        return lists[i];
+    }
+    unsigned int ListCount() const { return static_cast<unsigned int>(lists.size()); }
+
+    // merges and sorts everything recorded this frame, issues the draws and empties the lists
+    void Flush()
+    {
+        PROFILE_ZONE("RenderQueue::Flush");
+        stats = Stats();
+        for (CommandList &list : lists)
+        {
+            if (list.packets.empty())
+                continue;
+            stats.lists++;
+            for (const DrawPacket &packet : list.packets)
+            {
+                keys.push_back(packet.key);
+                order.push_back(static_cast<uint32_t>(items.size()));
+                items.push_back(Item{&packet, &list.transforms[packet.transform]});
+            }
+        }
+        stats.draws = static_cast<unsigned int>(items.size());
+        stats.unsorted = countStateChanges(); // order is still the identity permutation here
+
+        SortKeys(keys, order, keysScratch, orderScratch);
+        stats.sorted = countStateChanges();
+
+        // every draw's constants in draw order in one allocation, each slice aligned for glBindBufferRange
+        RingAllocation constants;
+        GLsizeiptr stride = 0;
+        if (constantsRing && !order.empty())
+        {
+            GLsizeiptr alignment = constantsRing->Alignment();
+            stride = (sizeof(DrawConstants) + alignment - 1) / alignment * alignment;
+            constants = constantsRing->Allocate(stride * static_cast<GLsizeiptr>(order.size()));
+            char *destination = static_cast<char*>(constants.data);
+            if (constants.IsValid())
+                for (size_t i = 0; i < order.size(); i++)
+                    memcpy(destination + i * stride, items[order[i]].model, sizeof(DrawConstants));
+        }
+
+        GLuint program = 0, vao = 0;
+        GLint modelLocation = -1;
+        bool useConstants = false;
+        unsigned int material = 0;
+        bool first = true;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            uint32_t index = order[i];
+            const DrawPacket &packet = *items[index].packet;
+            bool programChanged = first || packet.shader->ID != program;
+            if (programChanged)
+            {
+                packet.shader->use();
+                program = packet.shader->ID;
+                modelLocation = glGetUniformLocation(program, "model");
+                useConstants = constants.IsValid() && glGetUniformBlockIndex(program, "Draw") != GL_INVALID_INDEX;
+            }
+            // sampler uniforms are program state, so a new program needs its textures re-pointed as well
+            if (programChanged || packet.material != material)
+            {
+                packet.mesh->BindTextures(*packet.shader);
+                material = packet.material;
+            }
+            if (first || packet.mesh->VAO != vao)
+            {
+                glBindVertexArray(packet.mesh->VAO);
+                vao = packet.mesh->VAO;
+            }
+            if (useConstants)
+            {
+                constantsRing->BindRange(constantsBinding, constants.Slice(i * stride, sizeof(DrawConstants)));
+                stats.rangeBinds++;
+            }
+            else
+            {
+                glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &(*items[index].model)[0][0]);
+                stats.uniformSets++;
+            }
+            if (packet.submesh < 0)
+                packet.mesh->DrawElements();
+            else
+                packet.mesh->DrawSubMesh(packet.submesh);
+            first = false;
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+
+        items.clear();
+        keys.clear();
+        order.clear();
+        for (CommandList &list : lists)
+            list.Reset();
+    }
+
+    // counters for the most recent Flush
+    const Stats &LastFrameStats() const { return stats; }
+
+    static uint64_t MakeKey(RenderLayer layer, unsigned int program, unsigned int material, unsigned int vao, float viewDepth)
+    {
+        uint64_t l = static_cast<uint64_t>(layer) & 0x3;
+        uint64_t p = program & 0x3FF;
+        uint64_t m = material & 0x3FFF;
+        uint64_t v = vao & 0x3FFF;
+        uint64_t d = quantizeDepth(viewDepth);
+        if (layer == LAYER_TRANSPARENT)
+            return l << 62 | (~d & 0xFFFFFF) << 38 | p << 28 | m << 14 | v;
+        return l << 62 | p << 52 | m << 38 | v << 24 | d;
+    }
+
+    // LSD radix sort of keys (carrying order along) over 8-bit digits, stable, so equal keys keep the order they
+    // were recorded in. Digits that are equal for every key, which is typical for the layer and program bits, are
+    // detected from the histogram and skipped. The scratch vectors are resized to fit and can be kept between
+    // calls so sorting doesn't allocate.
+    static void SortKeys(vector<uint64_t> &keys, vector<uint32_t> &order, vector<uint64_t> &keysScratch,
+                         vector<uint32_t> &orderScratch)
+    {
+        size_t n = keys.size();
+        if (n < 2)
+            return;
+        keysScratch.resize(n);
+        orderScratch.resize(n);
+
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t counts[256] = {};
+            for (size_t i = 0; i < n; i++)
+                counts[(keys[i] >> shift) & 0xFF]++;
+            if (counts[(keys[0] >> shift) & 0xFF] == n)
+                continue;
+
+            size_t offset = 0;
+            for (size_t &count : counts)
+            {
+                size_t c = count;
+                count = offset;
+                offset += c;
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                size_t dst = counts[(keys[i] >> shift) & 0xFF]++;
+                keysScratch[dst] = keys[i];
+                orderScratch[dst] = order[i];
+            }
+            keys.swap(keysScratch);
+            order.swap(orderScratch);
+        }
+    }
+
+private:
+    // a recorded draw in the merged order, pointing into the list that holds it
+    struct Item {
+        const DrawPacket *packet;
+        const glm::mat4 *model;
+    };
+
+    vector<CommandList> lists;
+    RingBuffer *constantsRing = nullptr;
+    GLuint constantsBinding = 0;
+    vector<Item> items;
+    vector<uint64_t> keys;
+    vector<uint32_t> order;
+    // scratch space for the radix sort, kept between frames so sorting doesn't allocate
+    vector<uint64_t> keysScratch;
+    vector<uint32_t> orderScratch;
+    Stats stats;
+
+    // maps a non-negative float onto 24 bits preserving order: for positive IEEE floats the bit pattern grows
+    // with the value, so dropping the (zero) sign bit and the lowest mantissa bits keeps the ordering.
+    static uint64_t quantizeDepth(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return (bits >> 7) & 0xFFFFFF;
+    }
+
+    StateChanges countStateChanges() const
+    {
+        StateChanges changes;
+        const DrawPacket *previous = nullptr;
+        for (uint32_t index : order)
+        {
+            const DrawPacket &item = *items[index].packet;
+            bool programChanged = !previous || item.shader->ID != previous->shader->ID;
+            if (programChanged)
+                changes.programs++;
+            if (programChanged || item.material != previous->material)
+                changes.materials++;
+            if (!previous || item.mesh->VAO != previous->mesh->VAO)
+                changes.vaos++;
+            previous = &item;
+        }
+        return changes;
+    }
+};
+
+inline void CommandList::Draw(Shader &shader, Mesh &mesh, const glm::mat4 &model, float viewDepth, RenderLayer layer,
+                              int submesh)
+{
+    unsigned int material = mesh.MaterialKey();
+    packets.push_back(DrawPacket{RenderQueue::MakeKey(layer, shader.ID, material, mesh.VAO, viewDepth), &shader, &mesh,
+                                 material, static_cast<unsigned int>(transforms.size()), submesh});
+    transforms.push_back(model);
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "gl_interceptor.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// a piece of the ring handed out for this frame, data is only valid until EndFrame
+struct RingAllocation {
+    void *data = nullptr;
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+
+    bool IsValid() const { return data != nullptr; }
+
+    // size bytes starting offset bytes in, for binding part of a larger allocation
+    RingAllocation Slice(GLintptr offset, GLsizeiptr size) const
+    {
+        RingAllocation slice;
+        slice.data = static_cast<char*>(data) + offset;
+        slice.offset = this->offset + offset;
+        slice.size = size;
+        return slice;
+    }
+};
+
+// counters for one frame, reported by LastFrameStats after EndFrame
+struct RingBufferStats {
+    double fenceWaitMicroseconds = 0.0; // BeginFrame blocked on the GPU still reading the region
+    bool waited = false;
+    size_t bytesWritten = 0;
+    unsigned int allocations = 0;
+    unsigned int overflows = 0; // allocations refused because the frame's region was full
+};
+
+// Streams per-frame data (matrices, lights, per-draw constants) to the GPU without the driver copying or
+// synchronizing behind our back.
+//
+// With buffer storage (GL 4.4) the buffer is mapped once, persistent and coherent, and split into FRAME_COUNT
+// regions used in turn. Data is written straight into the mapping and bound with glBindBufferRange. A fence is
+// placed after each frame's draws, and before a region is reused BeginFrame waits on the fence from FRAME_COUNT
+// frames ago, which normally has long signalled. Without buffer storage the buffer is orphaned every frame and
+// writes are staged on the CPU, each BindRange uploading what was written since the last one into the fresh
+// storage.
+class RingBuffer {
+public:
+    static constexpr unsigned int FRAME_COUNT = 3;
+
+    // frameSize is the most a single frame can write
+    RingBuffer(GLenum target, GLsizeiptr frameSize) : target(target), frameSize(frameSize)
+    {
+        GLint offsetAlignment = 16;
+        if (target == GL_UNIFORM_BUFFER)
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        else if (target == GL_SHADER_STORAGE_BUFFER)
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        alignment = offsetAlignment > 0 ? offsetAlignment : 16;
+
+        persistent = GLAD_GL_VERSION_4_4;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, frameSize * FRAME_COUNT, nullptr, flags);
+            mapped = static_cast<char*>(glMapBufferRange(target, 0, frameSize * FRAME_COUNT, flags));
+            if (!mapped)
+            {
+                cout << "ERROR::RING_BUFFER:: persistent mapping failed, falling back to orphaning" << endl;
+                persistent = false;
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(target, buffer);
+            }
+        }
+        if (!persistent)
+        {
+            glBufferData(target, frameSize, nullptr, GL_STREAM_DRAW);
+            staging.resize(frameSize);
+        }
+        glBindBuffer(target, 0);
+    }
+
+    // needs the context it was created in still current. GL keeps the storage alive until draws already
+    // submitted have read it, so the fences are only deleted, not waited on.
+    ~RingBuffer()
+    {
+        for (GLsync &fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        if (mapped)
+        {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    // claims the next region, waiting for the GPU to finish with it if it must
+    void BeginFrame()
+    {
+        frameStats = RingBufferStats();
+        head = 0;
+        flushed = 0;
+        if (persistent)
+        {
+            frame = (frame + 1) % FRAME_COUNT;
+            waitForFence(fences[frame]);
+            base = frameSize * frame;
+        }
+        else
+        {
+            // new storage for this frame, the old one is freed once the draws reading it are done
+            glBindBuffer(target, buffer);
+            glBufferData(target, frameSize, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(target, 0);
+            base = 0;
+        }
+    }
+
+    // size bytes at the next aligned offset, invalid when the frame's region is full
+    RingAllocation Allocate(GLsizeiptr size)
+    {
+        GLintptr offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > frameSize)
+        {
+            frameStats.overflows++;
+            return RingAllocation();
+        }
+        head = offset + size;
+        frameStats.allocations++;
+        frameStats.bytesWritten += size;
+
+        RingAllocation allocation;
+        allocation.offset = base + offset;
+        allocation.size = size;
+        allocation.data = persistent ? mapped + base + offset : staging.data() + offset;
+        return allocation;
+    }
+
+    // allocates and copies a value in, its layout must match the shader's (std140 for uniform blocks)
+    template <typename T>
+    RingAllocation Write(const T &value)
+    {
+        RingAllocation allocation = Allocate(sizeof(T));
+        if (allocation.IsValid())
+            memcpy(allocation.data, &value, sizeof(T));
+        return allocation;
+    }
+
+    // replaces what an allocation of this frame holds, e.g. to late-latch data the draws haven't been submitted
+    // with yet. Must come before any draw that reads the allocation.
+    template <typename T>
+    void Overwrite(const RingAllocation &allocation, const T &value)
+    {
+        if (!allocation.IsValid())
+            return;
+        memcpy(allocation.data, &value, sizeof(T));
+        if (persistent)
+            GLInterceptor::MarkWritten(allocation.data, sizeof(T));
+        else if (allocation.offset < flushed)
+        {
+            glBindBuffer(target, buffer);
+            glBufferSubData(target, allocation.offset, sizeof(T), allocation.data);
+            glBindBuffer(target, 0);
+        }
+    }
+
+    // binds an allocation to an indexed binding point of the buffer's target, after it has been written
+    void BindRange(GLuint index, const RingAllocation &allocation)
+    {
+        if (!allocation.IsValid())
+            return;
+        // a GL capture can't see writes through the mapping, it records the bound bytes before the next draw
+        if (persistent)
+            GLInterceptor::MarkWritten(allocation.data, static_cast<size_t>(allocation.size));
+        if (!persistent && flushed < head)
+        {
+            glBindBuffer(target, buffer);
+            glBufferSubData(target, flushed, head - flushed, staging.data() + flushed);
+            glBindBuffer(target, 0);
+            flushed = head;
+        }
+        glBindBufferRange(target, index, buffer, allocation.offset, allocation.size);
+    }
+
+    // fences the region after the frame's last draw that reads it
+    void EndFrame()
+    {
+        if (persistent)
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        lastFrameStats = frameStats;
+    }
+
+    bool IsPersistent() const { return persistent; }
+    GLuint Buffer() const { return buffer; }
+    GLint Alignment() const { return alignment; }
+    const RingBufferStats &LastFrameStats() const { return lastFrameStats; }
+
+private:
+    GLenum target;
+    GLsizeiptr frameSize;
+    GLint alignment;
+    bool persistent;
+    GLuint buffer = 0;
+    char *mapped = nullptr;
+    vector<char> staging;
+    GLsync fences[FRAME_COUNT] = {};
+    unsigned int frame = 0;
+    GLintptr base = 0, head = 0, flushed = 0;
+    RingBufferStats frameStats, lastFrameStats;
+
+    void waitForFence(GLsync &fence)
+    {
+        if (!fence)
+            return;
+        auto start = chrono::high_resolution_clock::now();
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+        {
+            frameStats.waited = true;
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+        }
+        if (result == GL_WAIT_FAILED)
+            cout << "ERROR::RING_BUFFER:: fence wait failed" << endl;
+        frameStats.fenceWaitMicroseconds = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Frame time against instance count and against light count, for both renderer paths, as CSV on stdout.
+#
+#   ./scaling.sh build/learnOpenGL > scaling.csv
+#
+# Every point is a headless benchmark over the default orbit of a generated scene, extra arguments are passed to
+# each run (e.g. --width 1920 --height 1080 or --layout clustered). The p50 and p95 columns are milliseconds.
+set -e
+
+binary=${1:?usage: $0 path/to/learnOpenGL [extra options]}
+shift
+report=$(mktemp)
+trap 'rm -f "$report"' EXIT
+
+# pulls "mean", "p50" and "p95" out of the report's "frame", "cpu" or "gpu" object
+summary() {
+    grep "\"$1\":" "$report" | sed -E 's/.*"mean": ([^,]*), .*"p50": ([^,]*), "p95": ([^,]*),.*/\1,\2,\3/'
+}
+
+run() {
+    "$binary" --headless --benchmark --frames 300 --warmup 30 --report "$report" "$@" > /dev/null
+    echo "$(summary frame),$(summary cpu),$(summary gpu)"
+}
+
+echo "path,instances,lights,frame_mean,frame_p50,frame_p95,cpu_mean,cpu_p50,cpu_p95,gpu_mean,gpu_p50,gpu_p95"
+for path in cpu gpu; do
+    flag=""
+    [ "$path" = gpu ] && flag="--gpu-driven"
+    for instances in 1 16 64 256 1024 4096 16384; do
+        echo "$path,$instances,0,$(run $flag --instances "$instances" "$@")"
+    done
+    for lights in 0 16 64 256 1024; do
+        echo "$path,256,$lights,$(run $flag --instances 256 --point-lights "$lights" "$@")"
+    done
+done
@@ -0,0 +1,143 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Node hierarchy with local transforms and cached world matrices.
+//
+// Nodes are stored in depth-first order, so every parent comes before its children and a node's subtree is the
+// contiguous range [node, SubtreeEnd(node)). SetLocal() only records the node as dirty; Update() then recomputes
+// world matrices for the dirty subtrees with one linear pass each, reading the parent's world matrix that the
+// pass has already written. A frame where nothing moved costs a single empty check.
+class SceneGraph {
+public:
+    static constexpr unsigned int NONE = ~0u;
+
+    // appends a node under parent (NONE for a root). Nodes have to be added depth first: parent must be the last
+    // node added or one of its ancestors, which is what a recursive walk of the source hierarchy produces.
+    unsigned int AddNode(unsigned int parent, const glm::mat4 &local, const string &name = "")
+    {
+        unsigned int node = static_cast<unsigned int>(locals.size());
+        if (parent != NONE && (parent >= node || subtreeEnds[parent] != node))
+        {
+            cout << "ERROR::SCENE_GRAPH:: node " << name << " added out of depth-first order" << endl;
+            return NONE;
+        }
+        parents.push_back(parent);
+        subtreeEnds.push_back(node + 1);
+        locals.push_back(local);
+        worlds.push_back(local);
+        names.push_back(name);
+        dirty.push_back(0);
+        for (unsigned int ancestor = parent; ancestor != NONE; ancestor = parents[ancestor])
+            subtreeEnds[ancestor] = node + 1;
+        markDirty(node);
+        return node;
+    }
+
+    void SetLocal(unsigned int node, const glm::mat4 &local)
+    {
+        locals[node] = local;
+        markDirty(node);
+    }
+
+    // recomputes world matrices below every node changed since the last call, returns how many were written
+    unsigned int Update()
+    {
+        lastUpdateCount = 0;
+        if (dirtyNodes.empty())
+            return 0;
+
+        // in depth-first order a dirty node inside an earlier dirty subtree is covered by that subtree's pass
+        sort(dirtyNodes.begin(), dirtyNodes.end());
+        unsigned int covered = 0;
+        for (unsigned int node : dirtyNodes)
+        {
+            dirty[node] = 0;
+            if (node < covered)
+                continue;
+            covered = subtreeEnds[node];
+            updateRange(node, covered);
+            lastUpdateCount += covered - node;
+        }
+        dirtyNodes.clear();
+        return lastUpdateCount;
+    }
+
+    unsigned int Size() const { return static_cast<unsigned int>(locals.size()); }
+    unsigned int Parent(unsigned int node) const { return parents[node]; }
+    unsigned int SubtreeEnd(unsigned int node) const { return subtreeEnds[node]; }
+    const string &Name(unsigned int node) const { return names[node]; }
+    const glm::mat4 &Local(unsigned int node) const { return locals[node]; }
+    // only current after Update()
+    const glm::mat4 &World(unsigned int node) const { return worlds[node]; }
+    // world matrices of every node, indexed by node
+    const vector<glm::mat4> &Worlds() const { return worlds; }
+    bool IsDirty() const { return !dirtyNodes.empty(); }
+    unsigned int LastUpdateCount() const { return lastUpdateCount; }
+
+    // first node with the given name, NONE if there isn't one
+    unsigned int Find(const string &name) const
+    {
+        auto found = find(names.begin(), names.end(), name);
+        return found == names.end() ? NONE : static_cast<unsigned int>(found - names.begin());
+    }
+
+private:
+    vector<unsigned int> parents;
+    vector<unsigned int> subtreeEnds;
+    vector<glm::mat4> locals;
+    vector<glm::mat4> worlds;
+    vector<string> names;
+    vector<unsigned char> dirty;
+    vector<unsigned int> dirtyNodes;
+    unsigned int lastUpdateCount = 0;
+
+    void markDirty(unsigned int node)
+    {
+        if (dirty[node])
+            return;
+        dirty[node] = 1;
+        dirtyNodes.push_back(node);
+    }
+
+    void updateRange(unsigned int first, unsigned int end)
+    {
+        if (parents[first] == NONE)
+            worlds[first] = locals[first];
+        else
+            multiply(worlds[parents[first]], locals[first], worlds[first]);
+        for (unsigned int node = first + 1; node < end; node++)
+            multiply(worlds[parents[node]], locals[node], worlds[node]);
+    }
+
+    // out = a * b for column-major matrices, each column of out is a combination of a's columns
+    static void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]);
+        __m128 a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+        for (int column = 0; column < 4; column++)
+        {
+            __m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[column][0])), _mm_mul_ps(a1, _mm_set1_ps(b[column][1]))),
+                                       _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[column][2])), _mm_mul_ps(a3, _mm_set1_ps(b[column][3]))));
+            _mm_storeu_ps(&out[column][0], result);
+        }
+#else
+        out = a * b;
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+// instanced from an identity table, so this is the draw's baseInstance: the index the cull pass wrote
+layout (location = 7) in uint aInstance;
+
+// must match gpu_culling.h
+struct Instance {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint mesh;
+    uint material;
+    uint padding0;
+    uint padding1;
+};
+
+layout (std430, binding = 1) readonly buffer Instances {
+    Instance instances[];
+};
+
+out VS_OUT {
+    vec3 FragPos;
+    vec2 TexCoords;
+    mat3 TBN;
+} vs_out;
+flat out uint MaterialIndex;
+
+// per-frame constants streamed through the ring buffer, must match FrameConstants in main.cpp
+layout (std140, binding = 1) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPosition;
+    vec4 cameraDirection;
+};
+
+void main()
+{
+    mat4 model = instances[aInstance].model;
+    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
+    vs_out.TexCoords = aTexCoords;
+    vec3 T = normalize(vec3(model * vec4(aTangent,   0.0)));
+    vec3 B = normalize(vec3(model * vec4(aBitangent, 0.0)));
+    vec3 N = normalize(vec3(model * vec4(aNormal,    0.0)));
+    vs_out.TBN = mat3(T, B, N);
+    MaterialIndex = instances[aInstance].material;
+
+    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+}
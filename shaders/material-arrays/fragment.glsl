@@ -0,0 +1,271 @@
+#version 430 core
+out vec4 FragColor;
+
+struct Switches {
+    float directional, point, spot;
+};
+
+struct ADS {
+    float ambient, diffuse, specular;
+};
+
+struct Material {
+    float shininess;
+};
+
+// must match material.h
+#define MAX_TEXTURE_ARRAYS 8
+
+struct TextureSlot {
+    int array;
+    int layer;
+};
+
+struct MaterialSlots {
+    TextureSlot diffuse;
+    TextureSlot specular;
+    TextureSlot normal;
+    TextureSlot height;
+};
+
+layout (std430, binding = 0) readonly buffer Materials {
+    MaterialSlots materials[];
+};
+
+uniform sampler2DArray materialArrays[MAX_TEXTURE_ARRAYS];
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+#define NR_POINT_LIGHTS 4
+
+// any number of extra lights from the stress scene generator, must match stress_scene.h
+struct ScenePointLight {
+    vec4 positionRadius;
+    vec4 color;
+};
+
+struct SceneSpotLight {
+    vec4 positionRadius;
+    vec4 directionCutOff;
+    vec4 colorOuterCutOff;
+};
+
+// binding points from bindings.h
+layout (std430, binding = 5) readonly buffer ScenePointLights {
+    ScenePointLight scenePointLights[];
+};
+
+layout (std430, binding = 6) readonly buffer SceneSpotLights {
+    SceneSpotLight sceneSpotLights[];
+};
+
+uniform int scenePointLightCount = 0;
+uniform int sceneSpotLightCount = 0;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec2 TexCoords;
+    mat3 TBN;
+} vs_out;
+flat in uint MaterialIndex;
+
+uniform DirLight dirLight;
+uniform PointLight pointLights[NR_POINT_LIGHTS];
+uniform SpotLight spotLight;
+uniform Material material;
+uniform Switches switches;
+uniform ADS ads;
+
+// function prototypes
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSceneLight(vec3 position, float radius, vec3 color, vec3 normal, vec3 fragPos, vec3 viewDir);
+
+// samples a texture out of its array, the index is the same for the whole draw so it is dynamically uniform
+vec4 sampleSlot(TextureSlot slot, vec4 fallback) {
+    if (slot.array < 0)
+        return fallback;
+    return texture(materialArrays[slot.array], vec3(vs_out.TexCoords, float(slot.layer)));
+}
+
+vec3 diffuseColor() {
+    return sampleSlot(materials[MaterialIndex].diffuse, vec4(1.0)).rgb;
+}
+
+vec3 specularColor() {
+    return sampleSlot(materials[MaterialIndex].specular, vec4(0.0)).rgb;
+}
+
+vec3 combineAds(vec3 ambient, vec3 diffuse, vec3 specular) {
+    return ambient+diffuse+specular;
+//    vec3 result = vec3(0.0f);
+//    result += ambient * ads.ambient;
+//    result += diffuse * ads.diffuse;
+//    result += specular * ads.specular;
+//    return result;
+}
+
+void main()
+{
+    // properties
+    // a missing normal map falls back to the flat tangent-space normal
+    vec3 normalTex = sampleSlot(materials[MaterialIndex].normal, vec4(0.5, 0.5, 1.0, 1.0)).rgb;
+    vec3 norm = normalTex * 2. - 1.;
+    norm = normalize(vs_out.TBN * norm);
+    vec3 viewDir = normalize(spotLight.position - vs_out.FragPos);
+
+    // == =====================================================
+    // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
+    // For each phase, a calculate function is defined that calculates the corresponding color
+    // per lamp. In the main() function we take all the calculated colors and sum them up for
+    // this fragment's final color.
+    // == =====================================================
+    // phase 1: directional lighting
+    vec3 directional = CalcDirLight(dirLight, norm, viewDir);
+
+    // phase 2: point lights
+    vec3 ptLight = vec3(0);
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+        ptLight += CalcPointLight(pointLights[i], norm, vs_out.FragPos, viewDir);
+    for (int i = 0; i < scenePointLightCount; i++)
+        ptLight += CalcSceneLight(scenePointLights[i].positionRadius.xyz, scenePointLights[i].positionRadius.w,
+                                  scenePointLights[i].color.rgb, norm, vs_out.FragPos, viewDir);
+
+    // phase 3: spot light
+    vec3 spot = CalcSpotLight(spotLight, norm, vs_out.FragPos, viewDir);
+    for (int i = 0; i < sceneSpotLightCount; i++)
+    {
+        SceneSpotLight light = sceneSpotLights[i];
+        float theta = dot(normalize(light.positionRadius.xyz - vs_out.FragPos), normalize(-light.directionCutOff.xyz));
+        float intensity = clamp((theta - light.colorOuterCutOff.w) / (light.directionCutOff.w - light.colorOuterCutOff.w), 0.0, 1.0);
+        if (intensity > 0.0)
+            spot += intensity * CalcSceneLight(light.positionRadius.xyz, light.positionRadius.w, light.colorOuterCutOff.rgb,
+                                               norm, vs_out.FragPos, viewDir);
+    }
+
+    vec3 result = vec3(0);
+    result += directional * switches.directional;
+    result += ptLight * switches.point;
+    result += spot * switches.spot;
+
+    // set final output color
+    FragColor = vec4(result, 1.0);
+}
+
+// calculates the color when using a directional light.
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // combine results
+    vec3 ambient = light.ambient * diffuseColor();
+    vec3 diffuse = light.diffuse * diff * diffuseColor();
+    vec3 specular = light.specular * spec * specularColor();
+    return combineAds(ambient, diffuse, specular);
+}
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // combine results
+    vec3 ambient = light.ambient * diffuseColor();
+    vec3 diffuse = light.diffuse * diff * diffuseColor();
+    vec3 specular = light.specular * spec * specularColor();
+
+    return combineAds(ambient, diffuse, specular)*attenuation;
+}
+
+// calculates the color when using a spot light.
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // spotlight intensity
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // combine results
+    vec3 ambient = light.ambient * diffuseColor();
+    vec3 diffuse = light.diffuse * diff * diffuseColor();
+    vec3 specular = light.specular * spec * specularColor();
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    return combineAds(ambient, diffuse, specular);
+}
+
+
+
+
+// calculates the color from one of the stress scene's lights, which fade out smoothly to nothing at their radius
+vec3 CalcSceneLight(vec3 position, float radius, vec3 color, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    float distance = length(position - fragPos);
+    if (distance >= radius)
+        return vec3(0.0);
+    vec3 lightDir = (position - fragPos) / distance;
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // inverse square attenuation windowed to reach zero at the radius
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    float attenuation = window * window / (distance * distance + 1.0);
+    return (color * diff * diffuseColor() + color * spec * specularColor()) * attenuation;
+}
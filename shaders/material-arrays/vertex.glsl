@@ -0,0 +1,41 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+// instanced from an identity table, so this is the draw's baseInstance: the mesh's material index
+layout (location = 7) in uint aMaterial;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec2 TexCoords;
+    mat3 TBN;
+} vs_out;
+flat out uint MaterialIndex;
+
+// per-frame constants streamed through the ring buffer, must match FrameConstants in main.cpp
+layout (std140, binding = 1) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPosition;
+    vec4 cameraDirection;
+};
+
+// this draw's slice of the per-draw constants, must match RenderQueue::DrawConstants
+layout (std140, binding = 2) uniform Draw {
+    mat4 model;
+};
+
+void main()
+{
+    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
+    vs_out.TexCoords = aTexCoords;
+    vec3 T = normalize(vec3(model * vec4(aTangent,   0.0)));
+    vec3 B = normalize(vec3(model * vec4(aBitangent, 0.0)));
+    vec3 N = normalize(vec3(model * vec4(aNormal,    0.0)));
+    vs_out.TBN = mat3(T, B, N);
+    MaterialIndex = aMaterial;
+
+    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+}
@@ -0,0 +1,346 @@
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "bindings.h"
+#include "bounds.h"
+#include "bvh.h"
+#include "entity_store.h"
+#include "frustum.h"
+#include "gpu_culling.h"
+#include "job_system.h"
+#include "model.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum SceneLayout {
+    LAYOUT_GRID,      // rows and columns on the ground plane
+    LAYOUT_RANDOM,    // uniformly scattered over the same area
+    LAYOUT_CLUSTERED  // bunched around random centers, with empty space between the clusters
+};
+
+struct StressSceneSettings {
+    unsigned int instances = 0;    // copies of the model, 0 keeps the single model
+    SceneLayout layout = LAYOUT_GRID;
+    float spacing = 0.0f;          // between neighbouring instances, 0 picks one from the model's size
+    unsigned int pointLights = 0;
+    unsigned int spotLights = 0;
+    float lightRadius = 10.0f;     // lights don't reach past this distance
+    bool moving = false;           // instances spin and bob, lights circle
+    unsigned int seed = 1;
+
+    bool IsEmpty() const { return instances == 0 && pointLights == 0 && spotLights == 0; }
+};
+
+// std430 layouts of the ScenePointLights and SceneSpotLights buffers in the material-arrays fragment shader
+struct ScenePointLight {
+    glm::vec4 positionRadius;
+    glm::vec4 color;
+};
+struct SceneSpotLight {
+    glm::vec4 positionRadius;
+    glm::vec4 directionCutOff;     // cosine of the inner cone angle in w
+    glm::vec4 colorOuterCutOff;    // cosine of the outer cone angle in w
+};
+
+// counters for the most recent Draw
+struct StressSceneStats {
+    unsigned int visibleInstances = 0;
+    unsigned int draws = 0;
+    double updateMicroseconds = 0.0;
+    double cullMicroseconds = 0.0;
+};
+
+// Generated content for scaling benchmarks: many copies of one model and many lights.
+//
+// Instances are entities in an EntityStore, whose world bounds feed a SceneBVH. The CPU path culls instances
+// against the frustum through the BVH and records every mesh of each visible instance into the render queue, in
+// parallel on the job system. The GPU path gets one GpuCuller instance per instance and mesh instead. Lights are
+// uploaded to two shader storage buffers read by the material-arrays fragment shader after its fixed lights.
+// Everything placed is drawn from a seeded generator, so a given set of settings always builds the same scene.
+class StressScene {
+public:
+    StressScene(Model &model, const StressSceneSettings &settings, JobSystem *jobs = nullptr)
+        : model(model), settings(settings), jobs(jobs), entities(jobs), random(settings.seed)
+    {
+        glm::vec3 size = model.bounds.IsEmpty() ? glm::vec3(1.0f) : model.bounds.Extents() * 2.0f;
+        spacing = settings.spacing > 0.0f ? settings.spacing : max(size.x, size.z) * 1.5f;
+        // instances fill a square about as wide as a grid of them would be
+        halfWidth = 0.5f * spacing * ceilf(sqrtf(static_cast<float>(max(1u, settings.instances))));
+
+        placeInstances();
+        placeLights();
+        entities.Update();
+        updateBounds();
+        bvh.Build(instanceBounds);
+    }
+
+    // needs the context the light buffers were made in still current
+    ~StressScene()
+    {
+        if (pointLightBuffer)
+            glDeleteBuffers(1, &pointLightBuffer);
+        if (spotLightBuffer)
+            glDeleteBuffers(1, &spotLightBuffer);
+    }
+
+    StressScene(const StressScene &) = delete;
+    StressScene &operator=(const StressScene &) = delete;
+
+    // moves everything to where it is at the given simulation time, then refits the BVH and, when given, the GPU
+    // culler's instances
+    void Update(float time, GpuCuller *gpuCuller = nullptr)
+    {
+        if (!settings.moving)
+            return;
+        PROFILE_ZONE("StressScene::Update");
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < handles.size(); i++)
+        {
+            const Motion &motion = motions[i];
+            glm::vec3 position = motion.base + glm::vec3(0.0f, motion.bob * sinf(time * motion.speed + motion.phase), 0.0f);
+            entities.SetPosition(handles[i], position);
+            entities.SetRotation(handles[i], glm::angleAxis(motion.phase + time * motion.speed, glm::vec3(0.0f, 1.0f, 0.0f)));
+        }
+        entities.Update();
+        updateBounds();
+        bvh.Update(instanceBounds);
+        if (gpuCuller)
+            for (size_t i = 0; i < handles.size(); i++)
+            {
+                glm::mat4 world = entities.World(entities.IndexOf(handles[i]));
+                for (unsigned int m = 0; m < model.meshes.size(); m++)
+                    gpuCuller->SetTransform(firstGpuInstance + static_cast<unsigned int>(i * model.meshes.size()) + m,
+                                            world * model.MeshTransform(m));
+            }
+
+        // lights circle their starting point
+        for (size_t i = 0; i < pointLights.size(); i++)
+            pointLights[i].positionRadius = glm::vec4(circle(pointLightBases[i], time, i), settings.lightRadius);
+        for (size_t i = 0; i < spotLights.size(); i++)
+            spotLights[i].positionRadius = glm::vec4(circle(spotLightBases[i], time, i), settings.lightRadius);
+        lightsDirty = true;
+        stats.updateMicroseconds = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // adds every instance's meshes to the GPU culler, the model's meshes must have been added to it first and in
+    // order so that mesh i of the model is the culler's mesh i
+    void AddTo(GpuCuller &gpuCuller)
+    {
+        firstGpuInstance = gpuCuller.InstanceCount();
+        for (size_t i = 0; i < handles.size(); i++)
+        {
+            glm::mat4 world = entities.World(entities.IndexOf(handles[i]));
+            for (unsigned int m = 0; m < model.meshes.size(); m++)
+                gpuCuller.AddInstance(m, world * model.MeshTransform(m));
+        }
+    }
+
+    // queues the meshes of every instance inside the frustum. With a job system recording is spread over its
+    // workers like Model::Draw, so the queue needs a list per job system thread.
+    void Draw(Shader &shader, RenderQueue &queue, const Frustum &frustum, const glm::mat4 &view,
+              RenderLayer layer = LAYER_OPAQUE)
+    {
+        PROFILE_ZONE("StressScene::Draw");
+        auto start = chrono::high_resolution_clock::now();
+        visible.clear();
+        bvh.Cull(frustum, visible);
+        stats.cullMicroseconds = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+        stats.visibleInstances = static_cast<unsigned int>(visible.size());
+        stats.draws = static_cast<unsigned int>(visible.size() * model.meshes.size());
+
+        auto record = [&](size_t begin, size_t end) {
+            CommandList &list = queue.List(jobs ? JobSystem::CurrentWorker() : 0);
+            for (size_t v = begin; v < end; v++)
+            {
+                glm::mat4 world = entities.World(entities.IndexOf(handles[visible[v]]));
+                for (unsigned int m = 0; m < model.meshes.size(); m++)
+                {
+                    glm::mat4 transform = world * model.MeshTransform(m);
+                    float depth = -(view * transform * glm::vec4(model.meshes[m].bounds.sphere.center, 1.0f)).z;
+                    list.Draw(shader, model.meshes[m], transform, depth, layer);
+                }
+            }
+        };
+        if (jobs)
+            jobs->ParallelFor(visible.size(), RECORD_GRAIN, record);
+        else
+            record(0, visible.size());
+    }
+
+    // binds the light buffers and tells the shader how many lights they hold, uploading them first if they moved
+    void BindLights(Shader &shader)
+    {
+        if (lightsDirty)
+        {
+            upload(pointLightBuffer, pointLights);
+            upload(spotLightBuffer, spotLights);
+            lightsDirty = false;
+        }
+        if (pointLightBuffer)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_POINT_LIGHT_BINDING, pointLightBuffer);
+        if (spotLightBuffer)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_SPOT_LIGHT_BINDING, spotLightBuffer);
+        shader.setInt("scenePointLightCount", static_cast<int>(pointLights.size()));
+        shader.setInt("sceneSpotLightCount", static_cast<int>(spotLights.size()));
+    }
+
+    size_t InstanceCount() const { return handles.size(); }
+    size_t LightCount() const { return pointLights.size() + spotLights.size(); }
+    // draws a frame can queue at most, for sizing the constants ring
+    size_t MaxDraws() const { return handles.size() * model.meshes.size(); }
+    // half the width of the area everything was placed in, centered on the origin
+    float Radius() const { return halfWidth; }
+    const StressSceneStats &LastFrameStats() const { return stats; }
+
+    static bool ParseLayout(const string &name, SceneLayout &layout)
+    {
+        if (name == "grid")
+            layout = LAYOUT_GRID;
+        else if (name == "random")
+            layout = LAYOUT_RANDOM;
+        else if (name == "clustered")
+            layout = LAYOUT_CLUSTERED;
+        else
+            return false;
+        return true;
+    }
+
+private:
+    // instances per recording job
+    static constexpr size_t RECORD_GRAIN = 32;
+    // instances per cluster in the clustered layout
+    static constexpr unsigned int CLUSTER_SIZE = 64;
+
+    struct Motion {
+        glm::vec3 base;
+        float speed, phase, bob;
+    };
+
+    Model &model;
+    StressSceneSettings settings;
+    JobSystem *jobs;
+    EntityStore entities;
+    SceneBVH bvh;
+    mt19937 random;
+    float spacing, halfWidth;
+
+    vector<EntityHandle> handles;
+    vector<Motion> motions;
+    vector<AABB> instanceBounds;
+    vector<unsigned int> visible;
+    unsigned int firstGpuInstance = 0;
+
+    vector<ScenePointLight> pointLights;
+    vector<SceneSpotLight> spotLights;
+    vector<glm::vec3> pointLightBases, spotLightBases;
+    GLuint pointLightBuffer = 0, spotLightBuffer = 0;
+    bool lightsDirty = true;
+    StressSceneStats stats;
+
+    float uniform(float low, float high) { return uniform_real_distribution<float>(low, high)(random); }
+
+    void placeInstances()
+    {
+        unsigned int side = static_cast<unsigned int>(ceilf(sqrtf(static_cast<float>(settings.instances))));
+        vector<glm::vec3> clusters;
+        if (settings.layout == LAYOUT_CLUSTERED)
+            for (unsigned int c = 0; c < max(1u, settings.instances / CLUSTER_SIZE); c++)
+                clusters.push_back(glm::vec3(uniform(-halfWidth, halfWidth), 0.0f, uniform(-halfWidth, halfWidth)));
+        normal_distribution<float> scatter(0.0f, spacing * 2.0f);
+
+        for (unsigned int i = 0; i < settings.instances; i++)
+        {
+            glm::vec3 position;
+            if (settings.layout == LAYOUT_GRID)
+                position = glm::vec3((i % side + 0.5f) * spacing - halfWidth, 0.0f, (i / side + 0.5f) * spacing - halfWidth);
+            else if (settings.layout == LAYOUT_RANDOM)
+                position = glm::vec3(uniform(-halfWidth, halfWidth), 0.0f, uniform(-halfWidth, halfWidth));
+            else
+                position = clusters[i % clusters.size()] + glm::vec3(scatter(random), 0.0f, scatter(random));
+
+            Motion motion{position, uniform(0.2f, 1.0f), uniform(0.0f, 6.2831853f), spacing * 0.1f};
+            glm::quat rotation = glm::angleAxis(motion.phase, glm::vec3(0.0f, 1.0f, 0.0f));
+            handles.push_back(entities.Create(position, rotation, glm::vec3(1.0f), model.bounds, i));
+            motions.push_back(motion);
+        }
+    }
+
+    void placeLights()
+    {
+        float height = model.bounds.IsEmpty() ? 1.0f : model.bounds.max.y + spacing * 0.25f;
+        for (unsigned int i = 0; i < settings.pointLights; i++)
+        {
+            glm::vec3 position(uniform(-halfWidth, halfWidth), uniform(0.0f, height), uniform(-halfWidth, halfWidth));
+            pointLightBases.push_back(position);
+            pointLights.push_back(ScenePointLight{glm::vec4(position, settings.lightRadius), glm::vec4(color(), 1.0f)});
+        }
+        for (unsigned int i = 0; i < settings.spotLights; i++)
+        {
+            glm::vec3 position(uniform(-halfWidth, halfWidth), height + spacing * 0.5f, uniform(-halfWidth, halfWidth));
+            // mostly down, tilted up to 30 degrees
+            float tilt = glm::radians(uniform(0.0f, 30.0f)), heading = uniform(0.0f, 6.2831853f);
+            glm::vec3 direction(sinf(tilt) * cosf(heading), -cosf(tilt), sinf(tilt) * sinf(heading));
+            spotLightBases.push_back(position);
+            spotLights.push_back(SceneSpotLight{glm::vec4(position, settings.lightRadius),
+                                                glm::vec4(direction, cosf(glm::radians(20.0f))),
+                                                glm::vec4(color(), cosf(glm::radians(25.0f)))});
+        }
+    }
+
+    // a saturated color of random hue
+    glm::vec3 color()
+    {
+        float hue = uniform(0.0f, 6.0f);
+        glm::vec3 rgb(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f));
+        return glm::clamp(rgb, glm::vec3(0.0f), glm::vec3(1.0f));
+    }
+
+    glm::vec3 circle(const glm::vec3 &base, float time, size_t i) const
+    {
+        float angle = time * 0.5f + i;
+        return base + glm::vec3(cosf(angle), 0.0f, sinf(angle)) * spacing;
+    }
+
+    void updateBounds()
+    {
+        instanceBounds.resize(handles.size());
+        for (size_t i = 0; i < handles.size(); i++)
+            instanceBounds[i] = entities.Bounds(entities.IndexOf(handles[i]));
+    }
+
+    template <typename T>
+    static void upload(GLuint &buffer, const vector<T> &lights)
+    {
+        if (lights.empty())
+            return;
+        if (!buffer)
+        {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, lights.size() * sizeof(T), lights.data(), GL_DYNAMIC_DRAW);
+        }
+        else
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lights.size() * sizeof(T), lights.data());
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+
+#endif
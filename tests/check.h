@@ -0,0 +1,22 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+// the tests' one assertion: prints what failed and carries on, main returns Failures() so ctest sees it
+inline int &Failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                                   \
+    do {                                                                                                   \
+        if (!(condition))                                                                                  \
+        {                                                                                                  \
+            std::cout << "ERROR::TEST:: " << __FILE__ << ":" << __LINE__ << " " #condition << std::endl; \
+            Failures()++;                                                                                  \
+        }                                                                                                  \
+    } while (false)
+
+#endif
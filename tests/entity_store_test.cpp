@@ -0,0 +1,55 @@
+#include "check.h"
+#include "entity_store.h"
+
+static glm::vec3 position(const EntityStore &entities, EntityHandle handle)
+{
+    size_t index = entities.IndexOf(handle);
+    return glm::vec3(entities.Data(EntityStore::POSITION_X)[index], entities.Data(EntityStore::POSITION_Y)[index],
+                     entities.Data(EntityStore::POSITION_Z)[index]);
+}
+
+static EntityHandle create(EntityStore &entities, const glm::vec3 &at)
+{
+    AABB unit;
+    unit.Expand(glm::vec3(-1.0f));
+    unit.Expand(glm::vec3(1.0f));
+    return entities.Create(at, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), unit, 0);
+}
+
+int main()
+{
+    EntityStore entities;
+    EntityHandle first = create(entities, glm::vec3(1.0f, 0.0f, 0.0f));
+    EntityHandle second = create(entities, glm::vec3(2.0f, 0.0f, 0.0f));
+
+    // the second entity moves into the first's dense index, the third takes the first's slot
+    entities.Destroy(first);
+    EntityHandle third = create(entities, glm::vec3(3.0f, 0.0f, 0.0f));
+    CHECK(third.slot == first.slot);
+    CHECK(!entities.IsAlive(first));
+    CHECK(entities.IsAlive(second) && entities.IsAlive(third));
+    CHECK(entities.Size() == 2);
+
+    // writes through the stale handle go nowhere
+    entities.SetPosition(first, glm::vec3(-1.0f));
+    entities.SetScale(first, glm::vec3(-1.0f));
+    entities.SetRotation(first, glm::quat(0.0f, 1.0f, 0.0f, 0.0f));
+    CHECK(position(entities, second) == glm::vec3(2.0f, 0.0f, 0.0f));
+    CHECK(position(entities, third) == glm::vec3(3.0f, 0.0f, 0.0f));
+    for (size_t i = 0; i < entities.Size(); i++)
+    {
+        CHECK(entities.Data(EntityStore::SCALE_X)[i] == 1.0f);
+        CHECK(entities.Data(EntityStore::ROTATION_W)[i] == 1.0f);
+    }
+
+    // and through a live one where they should
+    entities.SetPosition(third, glm::vec3(4.0f, 0.0f, 0.0f));
+    CHECK(position(entities, third) == glm::vec3(4.0f, 0.0f, 0.0f));
+
+    // destroying twice doesn't take anything else with it
+    entities.Destroy(first);
+    CHECK(entities.Size() == 2 && entities.IsAlive(second) && entities.IsAlive(third));
+
+    cout << "entity store: " << (Failures() == 0 ? "ok" : "failed") << endl;
+    return Failures();
+}
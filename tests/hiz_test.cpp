@@ -0,0 +1,88 @@
+#include "check.h"
+#include "gpu_culling.h"
+#include "headless.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+// 800x600 isn't a power of two, so the pyramid's coarse levels round down: level 6 is 12x9 texels of 64 pixels
+// with the leftovers folded into the last row and column
+static const int WIDTH = 800, HEIGHT = 600;
+
+// clears the depth of pixels x0..x1, y0..y1 (exclusive) to depth
+static void clearDepth(int x0, int y0, int x1, int y1, float depth)
+{
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, y0, x1 - x0, y1 - y0);
+    glClearDepth(depth);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+// a unit cube stretched over pixels x0..x1, y0..y1 and view space depths z0..z1
+static glm::mat4 placement(float x0, float y0, float x1, float y1, float z0, float z1)
+{
+    return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x0, y0, z0)), glm::vec3(x1 - x0, y1 - y0, z1 - z0));
+}
+
+static Mesh unitCube()
+{
+    vector<Vertex> vertices;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+        vertices.push_back(vertex);
+    }
+    vector<unsigned int> indices = {0, 1, 3, 0, 3, 2, 4, 5, 7, 4, 7, 6};
+    return Mesh(vertices, indices, {});
+}
+
+// culls one box against a pyramid of a wall at depth 0.5 with a hole of depth 1.0, true when it survives
+static bool survives(GpuCuller &culler, const glm::mat4 &viewProjection, int hole[4], const glm::mat4 &box)
+{
+    OffscreenTarget target(WIDTH, HEIGHT);
+    target.Bind();
+    clearDepth(0, 0, WIDTH, HEIGHT, 0.5f);
+    clearDepth(hole[0], hole[1], hole[2], hole[3], 1.0f);
+
+    culler.SetTransform(0, box);
+    culler.SetDepthViewProjection(viewProjection);
+    culler.UpdateDepthPyramid(WIDTH, HEIGHT);
+    culler.Cull(viewProjection, glm::mat4(1.0f));
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return culler.ReadDrawCount() == 1;
+}
+
+int main()
+{
+    HeadlessContext context;
+    if (!context.IsValid() || !gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress) || !GLAD_GL_VERSION_4_3)
+    {
+        cout << "hiz: no GL 4.3 context, skipped" << endl;
+        return 0;
+    }
+
+    GpuCuller culler(LEARNOPENGL_SOURCE_DIR "/shaders/gpu-culling/cull.comp", LEARNOPENGL_SOURCE_DIR "/shaders/gpu-culling/hiz.comp");
+    culler.AddInstance(culler.AddMesh(unitCube()), glm::mat4(1.0f));
+    culler.Upload();
+
+    // pixel space, view space z -1 lands at depth 0.5 so boxes at -1.4..-1.2 are behind the wall
+    glm::mat4 viewProjection = glm::ortho(0.0f, static_cast<float>(WIDTH), 0.0f, static_cast<float>(HEIGHT), 0.0f, 2.0f);
+
+    // the box spans 40 pixels, so it's tested at level 6. uv * 12 puts its x in texel 5, pixels 320-383, all wall,
+    // while the pixels are in texel 6.
+    int hole[4] = {384, 256, 400, 304};
+    CHECK(survives(culler, viewProjection, hole, placement(386, 260, 398, 300, -1.4f, -1.2f)));
+
+    // in the pixels folded into the last column and row
+    int corner[4] = {784, 560, 800, 600};
+    CHECK(survives(culler, viewProjection, corner, placement(788, 556, 798, 598, -1.4f, -1.2f)));
+
+    // all wall behind it, or in front of the wall
+    CHECK(!survives(culler, viewProjection, hole, placement(100, 100, 140, 140, -1.4f, -1.2f)));
+    CHECK(!survives(culler, viewProjection, hole, placement(300, 260, 360, 300, -1.4f, -1.2f)));
+    CHECK(survives(culler, viewProjection, hole, placement(100, 100, 140, 140, -0.8f, -0.6f)));
+
+    cout << "hiz: " << (Failures() == 0 ? "ok" : "failed") << endl;
+    return Failures();
+}
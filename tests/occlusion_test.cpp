@@ -0,0 +1,82 @@
+#include "check.h"
+#include "occlusion.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+// a quad from (x0, y0) to (x1, y1) at z, as the two triangles an occluder is made of
+static OccluderMesh wall(float x0, float y0, float x1, float y1, float z)
+{
+    OccluderMesh occluder;
+    glm::vec3 corners[6] = {{x0, y0, z}, {x1, y0, z}, {x1, y1, z}, {x0, y0, z}, {x1, y1, z}, {x0, y1, z}};
+    for (const glm::vec3 &corner : corners)
+    {
+        occluder.positions.push_back(corner);
+        occluder.bounds.Expand(corner);
+    }
+    return occluder;
+}
+
+static AABB box(const glm::vec3 &min, const glm::vec3 &max)
+{
+    AABB box;
+    box.Expand(min);
+    box.Expand(max);
+    return box;
+}
+
+static AABB cube(const glm::vec3 &center, float halfSize)
+{
+    return box(center - glm::vec3(halfSize), center + glm::vec3(halfSize));
+}
+
+int main()
+{
+    JobSystem jobs(2);
+    for (JobSystem *threads : {static_cast<JobSystem*>(nullptr), &jobs})
+    {
+        // a camera at the origin looking down -z at a wall 5 units away
+        OcclusionCuller culler(256, 128, threads);
+        culler.BeginFrame(glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f));
+        culler.AddOccluder(wall(-3.0f, -3.0f, 3.0f, 3.0f, -5.0f), glm::mat4(1.0f));
+        culler.Rasterize();
+        CHECK(!culler.IsVisible(cube(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f)));  // fully behind the wall
+        CHECK(culler.IsVisible(cube(glm::vec3(5.5f, 0.0f, -10.0f), 1.0f)));   // peeking past its edge
+        CHECK(culler.IsVisible(cube(glm::vec3(0.0f, 0.0f, -3.0f), 1.0f)));    // in front of it
+        CHECK(culler.IsVisible(cube(glm::vec3(0.0f, 0.0f, -6.0f), 3.0f)));    // reaching through it
+        CHECK(culler.IsVisible(cube(glm::vec3(0.0f, 0.0f, 0.0f), 0.5f)));     // around the camera
+        CHECK(!culler.IsVisible(cube(glm::vec3(1.0f, 1.0f, -40.0f), 5.0f)));  // big and far, tested at a coarse level
+        culler.EndFrame();
+        CHECK(culler.LastFrameStats().tested == 6 && culler.LastFrameStats().occluded == 2);
+    }
+
+    // the rest use an orthographic camera where world x and y are pixel coordinates
+    glm::mat4 pixels = glm::ortho(0.0f, 256.0f, 0.0f, 128.0f, 0.1f, 100.0f);
+    {
+        // a wall ending 0.7 of the way into pixel column 100 covers that column's centres but not all of it, a box
+        // in the uncovered part of the column can be seen
+        OcclusionCuller culler(256, 128);
+        culler.BeginFrame(pixels);
+        culler.AddOccluder(wall(10.0f, 10.0f, 100.7f, 100.0f, -10.0f), glm::mat4(1.0f));
+        culler.Rasterize();
+        CHECK(culler.IsVisible(box(glm::vec3(100.75f, 50.2f, -30.0f), glm::vec3(100.95f, 50.8f, -20.0f))));
+        CHECK(!culler.IsVisible(box(glm::vec3(99.2f, 50.2f, -30.0f), glm::vec3(99.8f, 50.8f, -20.0f))));
+        CHECK(culler.DepthBuffer()[50 * culler.Width() + 100] == OcclusionCuller::EMPTY);
+        CHECK(culler.DepthBuffer()[50 * culler.Width() + 99] < OcclusionCuller::EMPTY);
+    }
+    {
+        // the max-depth hierarchy: a hole in a wall keeps a large box behind it visible at every level, boxes
+        // whose 32 pixel texels stay clear of the hole are still hidden
+        OcclusionCuller culler(256, 128);
+        culler.BeginFrame(pixels);
+        culler.AddOccluder(wall(0.0f, 0.0f, 120.0f, 128.0f, -10.0f), glm::mat4(1.0f));
+        culler.AddOccluder(wall(124.0f, 0.0f, 256.0f, 128.0f, -10.0f), glm::mat4(1.0f));
+        culler.Rasterize();
+        CHECK(culler.IsVisible(box(glm::vec3(20.0f, 20.0f, -30.0f), glm::vec3(230.0f, 110.0f, -20.0f))));
+        CHECK(!culler.IsVisible(box(glm::vec3(10.0f, 20.0f, -30.0f), glm::vec3(90.0f, 110.0f, -20.0f))));
+        CHECK(!culler.IsVisible(box(glm::vec3(130.0f, 20.0f, -30.0f), glm::vec3(250.0f, 110.0f, -20.0f))));
+    }
+
+    if (Failures() == 0)
+        std::cout << "occlusion: ok" << std::endl;
+    return Failures();
+}
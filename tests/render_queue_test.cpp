@@ -0,0 +1,96 @@
+#include "check.h"
+#include "render_queue.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <numeric>
+#include <random>
+
+// sorts keys with SortKeys and checks the order against std::stable_sort of the same keys
+static void checkSort(const vector<uint64_t> &keys)
+{
+    vector<uint64_t> sorted = keys, keysScratch, expectedKeys;
+    vector<uint32_t> order(keys.size()), orderScratch;
+    iota(order.begin(), order.end(), 0u);
+    vector<uint32_t> expected = order;
+    stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    for (uint32_t index : expected)
+        expectedKeys.push_back(keys[index]);
+
+    RenderQueue::SortKeys(sorted, order, keysScratch, orderScratch);
+    CHECK(order == expected);
+    CHECK(sorted == expectedKeys);
+}
+
+int main()
+{
+    const unsigned int maxMaterial = 0x3FFF, maxVao = 0x3FFF;
+
+    // layers are drawn in ascending order whatever else is in the key: the highest opaque key sorts below the
+    // lowest transparent one and that below the lowest overlay, for program names past 8 bits too
+    for (unsigned int program : {0u, 255u, 256u, 700u, 1023u})
+    {
+        uint64_t opaque = RenderQueue::MakeKey(LAYER_OPAQUE, program, maxMaterial, maxVao, 1.0e30f);
+        uint64_t transparent = RenderQueue::MakeKey(LAYER_TRANSPARENT, program, 0, 0, 1.0e30f);
+        uint64_t overlay = RenderQueue::MakeKey(LAYER_OVERLAY, program, 0, 0, 0.0f);
+        CHECK(opaque >> 62 == LAYER_OPAQUE);
+        CHECK(transparent >> 62 == LAYER_TRANSPARENT);
+        CHECK(overlay >> 62 == LAYER_OVERLAY);
+        CHECK(opaque < RenderQueue::MakeKey(LAYER_TRANSPARENT, 0, 0, 0, 1.0e30f));
+        CHECK(transparent < overlay);
+    }
+
+    // within a layer the fields sort in order: program, then material, then vao, then depth front to back
+    CHECK(RenderQueue::MakeKey(LAYER_OPAQUE, 1, 0, 0, 0.0f) > RenderQueue::MakeKey(LAYER_OPAQUE, 0, maxMaterial, maxVao, 1.0e30f));
+    CHECK(RenderQueue::MakeKey(LAYER_OPAQUE, 0, 1, 0, 0.0f) > RenderQueue::MakeKey(LAYER_OPAQUE, 0, 0, maxVao, 1.0e30f));
+    CHECK(RenderQueue::MakeKey(LAYER_OPAQUE, 0, 0, 1, 0.0f) > RenderQueue::MakeKey(LAYER_OPAQUE, 0, 0, 0, 1.0e30f));
+    CHECK(RenderQueue::MakeKey(LAYER_OPAQUE, 0, 0, 0, 1.0f) < RenderQueue::MakeKey(LAYER_OPAQUE, 0, 0, 0, 2.0f));
+    // transparent draws back to front first
+    CHECK(RenderQueue::MakeKey(LAYER_TRANSPARENT, 1023, maxMaterial, maxVao, 2.0f) < RenderQueue::MakeKey(LAYER_TRANSPARENT, 0, 0, 0, 1.0f));
+
+    // the sort against std::stable_sort: random keys, every digit taking part
+    mt19937_64 random(26);
+    for (size_t n : {0, 1, 2, 3, 255, 256, 1000})
+    {
+        vector<uint64_t> keys(n);
+        for (uint64_t &key : keys)
+            key = random();
+        checkSort(keys);
+    }
+    // few distinct keys, so stability decides most of the order
+    vector<uint64_t> duplicates(1000);
+    for (uint64_t &key : duplicates)
+        key = random() % 4 * 0x0101010101010101ull;
+    checkSort(duplicates);
+    // all keys equal, every digit is skipped and the order stays as recorded
+    checkSort(vector<uint64_t>(500, 0x8000123456789ABCull));
+    // keys equal but for a single byte, only that digit is sorted on, with its first key's digit both the
+    // smallest and not
+    for (unsigned int shift = 0; shift < 64; shift += 8)
+    {
+        vector<uint64_t> keys(300);
+        for (uint64_t &key : keys)
+            key = (0x0123456789ABCDEFull & ~(0xFFull << shift)) | (random() % 16) << shift;
+        checkSort(keys);
+        keys[0] &= ~(0xFFull << shift);
+        checkSort(keys);
+        // and a single key that differs from all the others, first, last, in between, above and below them
+        for (size_t odd : {size_t(0), size_t(150), size_t(299)})
+            for (uint64_t digit : {0x00ull, 0xFFull})
+            {
+                vector<uint64_t> single(300, 0x7F7F7F7F7F7F7F7Full);
+                single[odd] = (single[odd] & ~(0xFFull << shift)) | digit << shift;
+                checkSort(single);
+            }
+    }
+    // keys as the queue makes them, the layer and program bits the same throughout
+    vector<uint64_t> made;
+    for (unsigned int i = 0; i < 1000; i++)
+        made.push_back(RenderQueue::MakeKey(LAYER_OPAQUE, 3, static_cast<unsigned int>(random() % 8),
+                                            static_cast<unsigned int>(random() % 8), static_cast<float>(random() % 100)));
+    checkSort(made);
+
+    if (Failures() == 0)
+        std::cout << "render queue: ok" << std::endl;
+    return Failures();
+}